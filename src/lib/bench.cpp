@@ -0,0 +1,282 @@
+#include "../portable.hpp"
+#ifdef _WIN32
+#include <psapi.h>
+#include "system.hpp"
+#include "file.hpp"
+#else
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+#endif
+
+static volatile size_t g_sink;
+
+// Runs batches of about 10 ms, and returns the median and minimum time of an iteration.
+static std::tuple<size_t, double, double> Measure(const Function<size_t()>& body)
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr auto target = std::chrono::milliseconds(10);
+    constexpr size_t samples = 15;
+
+    size_t iterations = 1;
+    for (;;)
+    {
+        const auto start = Clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            g_sink = g_sink + body();
+        if (Clock::now() - start >= target / 4 || iterations >= (1ull << 30))
+            break;
+        iterations *= 2;
+    }
+    iterations *= 4;
+
+    std::array<double, samples> times;
+    for (auto& time : times)
+    {
+        const auto start = Clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            g_sink = g_sink + body();
+        time = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    }
+    std::ranges::sort(times);
+    return { iterations, times[samples / 2], times[0] };
+}
+
+// Times up to 1000 calls one at a time, for about 2 s at most, and returns the 50th and 99th percentiles.
+static std::tuple<size_t, double, double> MeasureLatency(const Function<size_t()>& body)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto deadline = Clock::now() + std::chrono::seconds(2);
+
+    Vector<double> times;
+    while (times.size() < 1000 && (times.size() < 100 || Clock::now() < deadline))
+    {
+        const auto start = Clock::now();
+        g_sink = g_sink + body();
+        times.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+    }
+    std::ranges::sort(times);
+    return { times.size(), times[times.size() / 2], times[times.size() * 99 / 100] };
+}
+
+// Resolves the pattern, and checks the error and, if found, the path.
+static bool VerifyResolve(StrView pattern, const PathResolveOptions& options, DWORD expected, StrView target = L"")
+{
+    Path path(pattern);
+    const auto error = path.Resolve(options);
+    return error == expected && (target.empty() || path.ToString() == target);
+}
+
+DWORD RunBenchmarks(StrView filter, std::span<const Benchmark> extra)
+{
+    // A long path in the form returned by `ToString()`, and the same path in another case.
+    String longPath = L"\\\\?\\C:\\Program Files";
+    for (size_t i = 0; i < 48; ++i)
+        longPath += std::format(L"\\Segment {:02} of a deep directory tree", i);
+    String longPathUpper = StrFoldCase(longPath);
+    const Path parsedPath(longPath);
+    const Path parsedPathUpper(longPathUpper);
+
+    // 8^4 directories, with the file at the bottom; the misses search the whole tree.
+    MemoryFileSystem fs;
+    fs.Generate(L"C:\\tree", 4, 8, L"app.exe");
+    const MemoFileSystem memo(fs);
+    const StrView patternHit = L"C:\\tree\\*\\*.0\\?.0\\*\\app.exe";
+    const StrView patternMiss = L"C:\\tree\\*\\*.0\\?.0\\*\\missing.exe";
+
+    // A chain of 256 directories, with the file at the bottom, searched through wildcard segments.
+    fs.Generate(L"C:\\deep", 256, 1, L"app.exe");
+    String patternDeep = L"\\\\?\\C:\\deep";
+    for (size_t i = 0; i < 256; ++i)
+        patternDeep += L"\\*";
+    patternDeep += L"\\app.exe";
+    String deepTarget = L"\\\\?\\C:\\deep";
+    for (size_t i = 0; i < 256; ++i)
+        deepTarget += L"\\1.0";
+    deepTarget += L"\\app.exe";
+
+    Vector<String> args;
+    for (size_t i = 0; i < 2048; ++i)
+        args.push_back(i % 3 ? std::format(L"C:\\Source Files\\module {}.cpp", i) : std::format(L"/D\"NAME={}\"", i));
+    String cmdl;
+    for (const auto& arg : args)
+        AppendArgument(cmdl, arg);
+
+    // Directory names with version numbers, as matched by patterns and ranked.
+    Vector<String> versions;
+    for (size_t i = 0; i < 256; ++i)
+        versions.push_back(std::format(L"Python {}.{}.{}-amd64", 3 - i % 2, i % 14, i % 23));
+
+    Config config;
+    config.Set(L"file", L"C:\\Program Files\\Python\\3.*\\python.exe|C:\\Python3*\\python.exe");
+    config.Set(L"args", L"-X utf8 -B");
+    config.Set(L"wdir", L"C:\\Users\\Public\\Documents");
+    config.Set(L"resolve", L"threads=4 memo hedge=50");
+    config.Set(L"env", L"PYTHONUTF8=1|-PYTHONHOME");
+    config.Set(L"path", L"C:\\Tools\\bin;C:\\Tools\\lib");
+    const auto payload = config.ToPayload();
+
+    // An inherited environment block of about 45,000 characters, sorted by name, with a long `PATH`.
+    Vector<String> variables = { L"=C:=C:\\Users\\Public" };
+    for (size_t i = 0; i < 512; ++i)
+        variables.push_back(std::format(L"VARIABLE_{:03}=C:\\Program Files\\Vendor {}\\Product\\{}", i, i, String(i % 64, L'x')));
+    String inherited;
+    for (size_t i = 0; i < 128; ++i)
+        inherited += std::format(L"C:\\Program Files\\Tool {}\\bin;", i);
+    variables.push_back(std::format(L"Path={}", inherited));
+    std::ranges::sort(variables, [](StrView v1, StrView v2) -> bool { return StrCompare(v1, v2, true) < 0; });
+    String block;
+    for (const auto& variable : variables)
+        block.append(variable).append(1, L'\0');
+    block.append(1, L'\0');
+    const auto environment = Environment::Parse(L"PYTHONUTF8=1|-VARIABLE_100|ZZ=last", L"C:\\Tools\\bin;C:\\Tools\\lib");
+
+#ifdef _WIN32
+    // A 64 KiB text file in the temporary directory.
+    String tempPath(MAX_PATH + 1, L'\0');
+    tempPath.resize(GetTempPathW((DWORD)tempPath.size(), tempPath.data()));
+    const auto textPath = std::format(L"{}exelnk.bench.{}.txt", tempPath, GetCurrentProcessId());
+    File::WriteText(textPath, String(0x10000 / sizeof(wchar_t), L'x'));
+#else
+    // A directory of 4096 files in the temporary directory, listed in batches of `getdents64` on Linux.
+    const auto listPath = std::filesystem::temp_directory_path() / std::format("exelnk.bench.{}", getpid());
+    std::filesystem::create_directories(listPath);
+    for (size_t i = 0; i < 4096; ++i)
+        std::ofstream(listPath / std::format("file {:04}.txt", i));
+    const PosixFileSystem native(listPath.string());
+    const auto countNative = [&] {
+        size_t count = 0;
+        native.EnumerateFiles(L"C:\\*", [&](const FileEntry&) -> DWORD { ++count; return NO_ERROR; });
+        return count;
+    };
+#endif
+
+    Vector<Benchmark> benchmarks = {
+        { L"path.parse", [&] { return Path(longPath).SegmentCount(); } },
+        { L"path.tostring", [&] { return parsedPath.ToString(-1).size(); } },
+        { L"path.equal", [&] { return (size_t)(parsedPath == parsedPathUpper); } },
+        { L"str.equal.icase", [&] { return (size_t)StrEqual(longPath, longPathUpper, true); } },
+        { L"str.compare.icase", [&] { return (size_t)StrCompare(longPath, longPathUpper, true); } },
+        { L"str.foldcase", [&] { return StrFoldCase(longPath).size(); } },
+        { L"str.hash.icase", [&] { return StrHash(longPath, true); } },
+        { L"str.natural", [&] {
+            size_t count = 0;
+            for (size_t i = 1; i < versions.size(); ++i)
+                count += StrCompareNatural(versions[i - 1], versions[i]) > 0;
+            return count;
+        } },
+        { L"str.wildcard", [&] {
+            size_t count = 0;
+            for (const auto& version : versions)
+                count += WildcardMatch(L"python 3.1?.*-AMD64", version, true);
+            return count;
+        } },
+        { L"fs.enumerate", [&] {
+            size_t count = 0;
+            fs.EnumerateFiles(L"C:\\tree\\*", [&](const FileEntry& entry) -> DWORD { count += entry.name.size(); return NO_ERROR; });
+            return count;
+        } },
+        { L"fs.enumerate.memo", [&] {
+            size_t count = 0;
+            memo.EnumerateFiles(L"C:\\tree\\1.0\\*", [&](const FileEntry& entry) -> DWORD { count += entry.name.size(); return NO_ERROR; });
+            return count;
+        } },
+        { L"resolve.hit", [&] {
+            Path path(patternHit);
+            return (size_t)path.Resolve({ .fs = &fs });
+        }, [&] {
+            return VerifyResolve(patternHit, { .fs = &fs }, ERROR_RESOURCE_ENUM_USER_STOP, L"\\\\?\\C:\\tree\\1.0\\1.0\\1.0\\1.0\\app.exe");
+        } },
+        { L"resolve.hit.rank", [&] {
+            Path path(patternHit);
+            return (size_t)path.Resolve({ .fs = &fs, .flags = PATH_RESOLVE_FLAG_RANK });
+        }, [&] {
+            return VerifyResolve(patternHit, { .fs = &fs, .flags = PATH_RESOLVE_FLAG_RANK }, ERROR_RESOURCE_ENUM_USER_STOP, L"\\\\?\\C:\\tree\\8.0\\8.0\\8.0\\8.0\\app.exe");
+        } },
+        { L"resolve.miss", [&] {
+            Path path(patternMiss);
+            return (size_t)path.Resolve({ .fs = &fs });
+        }, [&] {
+            return VerifyResolve(patternMiss, { .fs = &fs }, ERROR_NO_MORE_FILES);
+        } },
+        { L"resolve.miss.memo", [&] {
+            Path path(patternMiss);
+            return (size_t)path.Resolve({ .fs = &fs, .flags = PATH_RESOLVE_FLAG_MEMO });
+        }, [&] {
+            return VerifyResolve(patternMiss, { .fs = &fs, .flags = PATH_RESOLVE_FLAG_MEMO }, ERROR_NO_MORE_FILES);
+        } },
+        { L"resolve.deep", [&] {
+            Path path(patternDeep);
+            return (size_t)path.Resolve({ .fs = &fs });
+        }, [&] {
+            return VerifyResolve(patternDeep, { .fs = &fs }, ERROR_RESOURCE_ENUM_USER_STOP, deepTarget);
+        } },
+        { L"cmdl.append", [&] {
+            String str;
+            for (const auto& arg : args)
+                AppendArgument(str, arg);
+            return str.size();
+        } },
+        { L"cmdl.length", [&] {
+            size_t length = 0;
+            for (const auto& arg : args)
+                length += ArgumentLength(arg);
+            return length;
+        } },
+        { L"cmdl.parse", [&] { return ParseCommandLine(cmdl).size(); } },
+        { L"config.payload", [&] { return (size_t)Config::ParsePayload(payload).has_value(); } },
+        { L"env.merge", [&] { return environment.Merge(block.data()).value_or(L"").size(); } },
+    };
+#ifdef _WIN32
+    benchmarks.push_back({ L"file.readtext", [&] { return File::ReadText(textPath).value_or(L"").size(); } });
+#else
+    benchmarks.push_back({ L"fs.enumerate.native", countNative, [&] { return countNative() == 4096; } });
+#endif
+    benchmarks.insert(benchmarks.end(), extra.begin(), extra.end());
+
+    DWORD result = NO_ERROR;
+    for (const auto& benchmark : benchmarks)
+    {
+        if (!filter.empty() && !WildcardMatch(filter, benchmark.name, true))
+            continue;
+        if (benchmark.verify && !benchmark.verify())
+        {
+            PRINT(L"{{\"name\":\"{}\",\"error\":\"unexpected result\"}}", benchmark.name);
+            result = ERROR_INVALID_DATA;
+            continue;
+        }
+        if (benchmark.latency)
+        {
+            const auto [iterations, p50, p99] = MeasureLatency(benchmark.body);
+            PRINT(L"{{\"name\":\"{}\",\"iterations\":{},\"p50_ns\":{:.1f},\"p99_ns\":{:.1f}}}",
+                benchmark.name, iterations, p50, p99);
+            continue;
+        }
+        const auto [iterations, median, min] = Measure(benchmark.body);
+        PRINT(L"{{\"name\":\"{}\",\"iterations\":{},\"median_ns\":{:.1f},\"min_ns\":{:.1f}}}",
+            benchmark.name, iterations, median, min);
+    }
+
+#ifdef _WIN32
+    // The working set released by `TrimMemory`, like a shim before it waits for the target,
+    // and the page faults taken to run each function once more, like a shim after the wait.
+    if (filter.empty() || WildcardMatch(filter, L"memory.trim", true))
+    {
+        PROCESS_MEMORY_COUNTERS before { .cb = sizeof(before) }, after { .cb = sizeof(after) }, resumed { .cb = sizeof(resumed) };
+        GetProcessMemoryInfo(GetCurrentProcess(), &before, sizeof(before));
+        TrimMemory();
+        GetProcessMemoryInfo(GetCurrentProcess(), &after, sizeof(after));
+        for (const auto& benchmark : benchmarks)
+            if (!benchmark.latency)
+                g_sink = g_sink + benchmark.body();
+        GetProcessMemoryInfo(GetCurrentProcess(), &resumed, sizeof(resumed));
+        PRINT(L"{{\"name\":\"memory.trim\",\"working_set_before\":{},\"working_set_after\":{},\"page_faults_after\":{}}}",
+            before.WorkingSetSize, after.WorkingSetSize, resumed.PageFaultCount - after.PageFaultCount);
+    }
+    DeleteFileW(textPath.data());
+#else
+    std::error_code error;
+    std::filesystem::remove_all(listPath, error);
+#endif
+    return result;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/**
+ * Microbenchmarks of the functions in the launch path (`:BENCH:`), over synthetic inputs.
+ * The searches run against a `MemoryFileSystem` tree, so results do not depend on the volume.
+ * Each result is printed as a line of JSON, to be compared between builds:
+ * {"name":"path.parse","iterations":N,"median_ns":N,"min_ns":N}
+ * Functions that do I/O are timed one call at a time, and report the 50th and 99th percentiles instead:
+ * {"name":"launch.broker","iterations":N,"p50_ns":N,"p99_ns":N}
+ */
+struct Benchmark
+{
+    StrView name;
+    Function<size_t()> body; // returns a value that depends on the work, so it is not optimized out
+    Function<bool()> verify = nullptr; // checks the result once before measuring, so a broken function is not timed
+    bool latency = false; // timed one call at a time
+};
+
+DWORD RunBenchmarks(StrView filter, std::span<const Benchmark> extra = { });
@@ -0,0 +1,276 @@
+#include "../framework.hpp"
+
+bool LaunchConfig::IsValid(const FileSystem& fs) const
+{
+    return std::ranges::all_of(sources,
+        [&](const auto& source) -> bool {
+            return fs.GetLastWriteTime(source.first).value_or(0) == source.second;
+        }
+    ) && std::ranges::all_of(resolutions,
+        [&](const ResolveCache& resolution) -> bool {
+            return resolution.IsValid(fs);
+        }
+    );
+}
+
+// Returns the directories the configuration depends on: those of the sources, and those of the resolutions.
+Vector<String> LaunchConfig::Directories() const
+{
+    Vector<String> directories;
+    for (const auto& source : sources)
+        directories.emplace_back(Path(source.first).ToString(-1));
+    for (const auto& resolution : resolutions)
+        std::ranges::move(resolution.Directories(), std::back_inserter(directories));
+    std::ranges::sort(directories, [](StrView s1, StrView s2) -> bool { return StrCompare(s1, s2, true) < 0; });
+    const auto [first, last] = std::ranges::unique(directories, [](StrView s1, StrView s2) -> bool { return StrEqual(s1, s2, true); });
+    directories.erase(first, last);
+    return directories;
+}
+
+DirectoryWatcher::DirectoryWatcher()
+    : m_hPort(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1))
+{
+    if (m_hPort)
+        m_thread = std::thread(&DirectoryWatcher::Run, this);
+}
+
+// Cancels the reads, and waits for the thread to receive them before the watches are released.
+DirectoryWatcher::~DirectoryWatcher()
+{
+    if (!m_hPort) return;
+    {
+        std::scoped_lock lock(m_mutex);
+        m_stopping = true;
+        for (const auto& [path, watch] : m_watches)
+            if (watch->hDirectory != INVALID_HANDLE_VALUE)
+                CancelIoEx(watch->hDirectory, &watch->overlapped);
+    }
+    PostQueuedCompletionStatus(m_hPort, 0, 0, nullptr);
+    m_thread.join();
+    for (const auto& [path, watch] : m_watches)
+        if (watch->hDirectory != INVALID_HANDLE_VALUE)
+            CloseHandle(watch->hDirectory);
+    CloseHandle(m_hPort);
+}
+
+/**
+ * Watches the directory, or its nearest existing parent if it is missing.
+ * Returns the watch, whose change count is increased on each change; or null if it cannot be watched.
+ */
+std::shared_ptr<const DirectoryWatcher::Watch> DirectoryWatcher::Add(StrView path)
+{
+    if (!m_hPort) return nullptr;
+    const Path p(path);
+    std::scoped_lock lock(m_mutex);
+    for (auto count = (int64_t)p.SegmentCount(); count >= 0; --count)
+    {
+        const String directory(p.ToString(count));
+        if (const auto it = m_watches.find(directory); it != m_watches.end() && it->second->active)
+            return it->second;
+
+        const auto hDirectory = CreateFileW(directory.data(), FILE_LIST_DIRECTORY,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (hDirectory == INVALID_HANDLE_VALUE)
+        {
+            const auto error = GetLastError();
+            if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND)
+                continue;
+            return nullptr;
+        }
+        auto watch = std::make_shared<Watch>();
+        watch->path = directory;
+        watch->hDirectory = hDirectory;
+        if (!CreateIoCompletionPort(hDirectory, m_hPort, (ULONG_PTR)watch.get(), 0) || !Read(*watch))
+        {
+            CloseHandle(hDirectory);
+            return nullptr;
+        }
+        m_watches.insert_or_assign(directory, watch);
+        return watch;
+    }
+    return nullptr;
+}
+
+// Starts the next read of the changes. The entries of the directory, their names and write times are watched.
+bool DirectoryWatcher::Read(Watch& watch)
+{
+    ++m_pending;
+    if (ReadDirectoryChangesW(watch.hDirectory, watch.buffer, sizeof(watch.buffer), FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+        nullptr, &watch.overlapped, nullptr))
+        return true;
+    --m_pending;
+    return false;
+}
+
+// Counts the changes reported; an overflow of the buffer, or an error, also counts as a change.
+void DirectoryWatcher::Run()
+{
+    for (;;)
+    {
+        DWORD bytes;
+        ULONG_PTR key;
+        LPOVERLAPPED overlapped;
+        const auto result = GetQueuedCompletionStatus(m_hPort, &bytes, &key, &overlapped, INFINITE);
+        if (overlapped)
+        {
+            --m_pending;
+            std::scoped_lock lock(m_mutex);
+            auto& watch = *(Watch*)key;
+            ++watch.changes;
+            if (!result || m_stopping || !Read(watch))
+            {
+                // The directory was removed, or cannot be read: it is opened again by the next `Add`.
+                watch.active = false;
+                if (!m_stopping)
+                {
+                    CloseHandle(watch.hDirectory);
+                    watch.hDirectory = INVALID_HANDLE_VALUE;
+                }
+            }
+        }
+        else if (!result)
+            return;
+        if (m_stopping && !m_pending)
+            return;
+    }
+}
+
+Broker::Broker(Function<LaunchConfig(StrView)> load)
+    : m_load(std::move(load))
+{
+}
+
+/**
+ * Serves the requests of the shims until the pipe cannot be created.
+ * Each thread keeps an instance of the pipe, connected again as soon as a shim is served,
+ * so shims are served concurrently, and wait for a busy broker instead of resolving the paths themselves.
+ */
+DWORD Broker::Serve()
+{
+    const auto name = GetSessionPipeName(L"broker");
+    const auto count = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+    Vector<HANDLE> pipes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        // The first instance fails if another process owns the name, so shims are not served by an impostor.
+        const auto hPipe = CreateNamedPipeW(name.data(), PIPE_ACCESS_DUPLEX | (i ? 0 : FILE_FLAG_FIRST_PIPE_INSTANCE),
+            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES, 0x10000, 0x1000, 0, nullptr);
+        if (hPipe == INVALID_HANDLE_VALUE)
+        {
+            const auto error = GetLastError();
+            for (const auto h : pipes)
+                CloseHandle(h);
+            return error;
+        }
+        pipes.push_back(hPipe);
+    }
+
+    Vector<std::jthread> workers;
+    for (const auto hPipe : pipes | std::views::drop(1))
+        workers.emplace_back([this, hPipe] { for (;;) Accept(hPipe); });
+    for (;;) Accept(pipes[0]);
+}
+
+// Requests the launch configuration of the shim from the broker, if there is one.
+// The configuration is not set if a resolution limit was reached; the error is reported by the shim.
+Optional<LaunchConfig> Broker::Request(StrView modulePath)
+{
+    const auto hPipe = ConnectPipe(GetSessionPipeName(L"broker"));
+    if (hPipe == INVALID_HANDLE_VALUE)
+        return std::nullopt;
+
+    String response;
+    DWORD bytesWritten;
+    const auto result = WriteFile(hPipe, modulePath.data(), (DWORD)(modulePath.size() * sizeof(wchar_t)), &bytesWritten, nullptr)
+        && ReadMessage(hPipe, response) == NO_ERROR;
+    CloseHandle(hPipe);
+
+    const auto pos = response.find(L'\n');
+    const auto error = StrToInt(StrView(response).substr(0, pos));
+    if (!result || pos == response.npos || !error)
+        return std::nullopt;
+    LaunchConfig launch { .error = (DWORD)*error };
+    if (launch.error == NO_ERROR)
+    {
+        auto config = Config::Parse(StrView(response).substr(pos + 1));
+        if (!config) return std::nullopt;
+        launch.config = std::move(*config);
+    }
+    return launch;
+}
+
+// Serves the next shim connected to the instance of the pipe.
+void Broker::Accept(HANDLE hPipe)
+{
+    if (ConnectNamedPipe(hPipe, nullptr) || GetLastError() == ERROR_PIPE_CONNECTED)
+        Handle(hPipe);
+    DisconnectNamedPipe(hPipe);
+}
+
+DWORD Broker::Handle(HANDLE hPipe)
+{
+    String modulePath;
+    if (const auto error = ReadMessage(hPipe, modulePath); error != NO_ERROR)
+        return error;
+    const auto entry = Load(modulePath);
+
+    // A resolution limit reached is returned instead of the configuration, so the shim does not search again.
+    // Relative patterns are resolved by the shim, against its own current directory.
+    const auto& launch = entry->launch;
+    const auto response = launch.relative ? String()
+        : std::format(L"{}\n{}", launch.error, launch.error ? String() : launch.config.ToString());
+    DWORD bytesWritten;
+    return WriteFile(hPipe, response.data(), (DWORD)(response.size() * sizeof(wchar_t)), &bytesWritten, nullptr)
+        ? NO_ERROR : GetLastError();
+}
+
+/**
+ * Returns the configuration kept for the shim, or loads it again if a directory it depends on has changed.
+ * The watches are set after loading: a change made before is seen by the write times taken while loading,
+ * which are checked once; a later one is counted by the watches.
+ */
+std::shared_ptr<const Broker::Entry> Broker::Load(StrView modulePath)
+{
+    const auto& fs = FileSystem::Native();
+    const auto isCurrent = [&](const Entry& entry) -> bool {
+        return std::ranges::all_of(entry.watches, [](const auto& watch) -> bool { return watch.first->changes == watch.second; })
+            && (!entry.polled || entry.launch.IsValid(fs));
+    };
+
+    std::shared_ptr<const Entry> current;
+    {
+        std::scoped_lock lock(m_mutex);
+        if (const auto it = m_configs.find(modulePath); it != m_configs.end())
+            current = it->second;
+    }
+    if (current && isCurrent(*current))
+        return current;
+
+    // Loading may write the resolution caches of the shim, which changes it once more.
+    auto entry = std::make_shared<Entry>();
+    for (size_t attempt = 0; attempt < 3; ++attempt)
+    {
+        entry->launch = m_load(modulePath);
+        entry->watches.clear();
+        entry->polled = false;
+        for (const auto& directory : entry->launch.Directories())
+        {
+            if (auto watch = m_watcher.Add(directory))
+            {
+                const uint64_t changes = watch->changes;
+                entry->watches.emplace_back(std::move(watch), changes);
+            }
+            else entry->polled = true;
+        }
+        if (entry->launch.IsValid(fs))
+            break;
+        entry->polled = true;
+    }
+
+    std::scoped_lock lock(m_mutex);
+    m_configs.insert_or_assign(String(modulePath), entry);
+    return entry;
+}
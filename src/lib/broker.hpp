@@ -0,0 +1,84 @@
+#pragma once
+
+/**
+ * The configuration of a shim, with the wildcards of the `file` and `wdir` paths resolved.
+ * It remains valid as long as the files it was read from, and the resolved paths, have not changed.
+ */
+struct LaunchConfig
+{
+    Config config;
+    Vector<std::pair<String, uint64_t>> sources; // path, last write time
+    Vector<ResolveCache> resolutions;
+    DWORD error = NO_ERROR; // resolution limit reached, reported by the shim
+    bool relative = false;  // a pattern depends on the current directory or drive, so the result is not shared
+
+    bool IsValid(const FileSystem& fs) const;
+    Vector<String> Directories() const;
+};
+
+/**
+ * Watches directories with `ReadDirectoryChangesW`, on a thread that counts the changes of each one.
+ * A missing directory is watched through its nearest existing parent, where it would be created.
+ * A watch that fails (the directory was removed) counts a last change, and is replaced by the next `Add`.
+ */
+class DirectoryWatcher final
+{
+public:
+    struct Watch
+    {
+        String path;
+        HANDLE hDirectory = INVALID_HANDLE_VALUE;
+        OVERLAPPED overlapped { };
+        alignas(DWORD) std::byte buffer[0x400] { }; // the changes are counted, not read
+        std::atomic<uint64_t> changes = 0;
+        std::atomic<bool> active = true;
+    };
+
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    std::shared_ptr<const Watch> Add(StrView path);
+private:
+    bool Read(Watch& watch);
+    void Run();
+
+    HANDLE m_hPort;
+    std::mutex m_mutex;
+    std::unordered_map<String, std::shared_ptr<Watch>, StrFoldHash, StrFoldEqual> m_watches; // directory path
+    std::atomic<size_t> m_pending = 0; // reads not completed yet
+    std::atomic<bool> m_stopping = false;
+    std::thread m_thread;
+};
+
+/**
+ * A resident process (`:BROKER:`) that keeps the launch configurations of the shims in memory.
+ * Shims with the `broker` resolution option request their configuration through a local named pipe,
+ * and still create the process themselves, so the console, handles and exit code of the target remain their own.
+ * A configuration is loaded again once a directory it depends on reports a change.
+ * Request: <module path>  Response: <error>\n<configuration text>, empty if resolved against the broker's current directory
+ */
+class Broker final
+{
+public:
+    explicit Broker(Function<LaunchConfig(StrView)> load);
+
+    DWORD Serve();
+
+    static Optional<LaunchConfig> Request(StrView modulePath);
+private:
+    struct Entry
+    {
+        LaunchConfig launch;
+        Vector<std::pair<std::shared_ptr<const DirectoryWatcher::Watch>, uint64_t>> watches; // changes when loaded
+        bool polled = false; // a directory could not be watched, so the files are checked on each request
+    };
+
+    void Accept(HANDLE hPipe);
+    DWORD Handle(HANDLE hPipe);
+    std::shared_ptr<const Entry> Load(StrView modulePath);
+
+    Function<LaunchConfig(StrView)> m_load;
+    DirectoryWatcher m_watcher;
+    std::mutex m_mutex;
+    std::unordered_map<String, std::shared_ptr<const Entry>, StrFoldHash, StrFoldEqual> m_configs; // module path
+};
@@ -0,0 +1,136 @@
+#include "../portable.hpp"
+
+// Splits the next line off the text.
+static auto NextLine(StrView& text, StrView& line)
+{
+    if (text.empty()) return false;
+    const auto pos = text.find(L'\n');
+    line = text.substr(0, pos);
+    text.remove_prefix(pos == text.npos ? text.size() : pos + 1);
+    return true;
+}
+
+ResolveCache::ResolveCache(StrView pattern, StrView target)
+    : m_pattern(pattern)
+    , m_target(target)
+{
+}
+
+StrView ResolveCache::Pattern() const
+{
+    return m_pattern;
+}
+
+StrView ResolveCache::Target() const
+{
+    return m_target;
+}
+
+void ResolveCache::SetTarget(StrView target)
+{
+    m_target = target;
+}
+
+void ResolveCache::AddDirectory(const FileSystem& fs, StrView path)
+{
+    // A missing directory is stored with a zero time, so its creation is also detected.
+    m_directories.emplace_back(fs.GetLastWriteTime(path).value_or(0), path);
+}
+
+// Adds the directories searched by another resolution, whose result depends on them too.
+void ResolveCache::Merge(const ResolveCache& other)
+{
+    m_directories.insert(m_directories.end(), other.m_directories.begin(), other.m_directories.end());
+}
+
+bool ResolveCache::IsValid(const FileSystem& fs) const
+{
+    if (!fs.Exists(m_target))
+        return false;
+    return std::ranges::all_of(m_directories,
+        [&](const auto& directory) -> bool {
+            return fs.GetLastWriteTime(directory.second).value_or(0) == directory.first;
+        }
+    );
+}
+
+// Returns the directories the result depends on: those searched, and that of the target.
+Vector<String> ResolveCache::Directories() const
+{
+    Vector<String> directories;
+    for (const auto& directory : m_directories)
+        directories.push_back(directory.second);
+    if (!m_target.empty())
+        directories.emplace_back(Path(m_target).ToString(-1));
+    return directories;
+}
+
+/**
+ * Format:
+ * ```
+ * <pattern>
+ * <target>
+ * <time> <directory>
+ * ...
+ * ```
+ */
+String ResolveCache::ToString() const
+{
+    auto text = std::format(L"{}\n{}\n", m_pattern, m_target);
+    for (const auto& [time, path] : m_directories)
+        text += std::format(L"{:016X} {}\n", time, path);
+    return text;
+}
+
+Optional<ResolveCache> ResolveCache::Parse(StrView text)
+{
+    StrView pattern, target, line;
+    if (!NextLine(text, pattern) || !NextLine(text, target) || pattern.empty() || target.empty())
+        return std::nullopt;
+    ResolveCache cache(pattern, target);
+    while (NextLine(text, line))
+    {
+        const auto pos = line.find(L' ');
+        if (pos == line.npos)
+            return std::nullopt;
+        const auto time = StrToInt(String(line.substr(0, pos)), 16);
+        if (!time) return std::nullopt;
+        cache.m_directories.emplace_back((uint64_t)*time, line.substr(pos + 1));
+    }
+    return cache;
+}
+
+ResolveCacheRecorder::ResolveCacheRecorder(const FileSystem& fs, ResolveCache& cache)
+    : m_fs(fs)
+    , m_cache(cache)
+{
+}
+
+// Probes of literal paths depend on the directory that contains them, even if missing.
+DWORD ResolveCacheRecorder::GetAttributes(StrView path, DWORD& attributes) const
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_cache.AddDirectory(m_fs, Path(path).ToString(-1));
+    }
+    return m_fs.GetAttributes(path, attributes);
+}
+
+Optional<uint64_t> ResolveCacheRecorder::GetLastWriteTime(StrView path) const
+{
+    return m_fs.GetLastWriteTime(path);
+}
+
+DWORD ResolveCacheRecorder::EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        m_cache.AddDirectory(m_fs, Path(path).ToString(-1));
+    }
+    return m_fs.EnumerateFiles(path, fn);
+}
+
+DWORD ResolveCacheRecorder::EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const
+{
+    return m_fs.EnumerateStreams(path, fn);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+/**
+ * The result of a wildcard path resolution, stored next to the shim configuration.
+ * It records the last write time of every directory searched during the resolution;
+ * the result remains valid as long as none of them has changed and the target exists.
+ */
+class ResolveCache final
+{
+public:
+    explicit ResolveCache(StrView pattern, StrView target = L"");
+
+    StrView Pattern() const;
+    StrView Target() const;
+    void SetTarget(StrView target);
+    void AddDirectory(const FileSystem& fs, StrView path);
+    void Merge(const ResolveCache& other);
+    bool IsValid(const FileSystem& fs) const;
+    Vector<String> Directories() const;
+    String ToString() const;
+
+    static Optional<ResolveCache> Parse(StrView text);
+private:
+    String m_pattern; // absolute path pattern
+    String m_target;  // resolved path
+    Vector<std::pair<uint64_t, String>> m_directories; // last write time, path
+};
+
+/**
+ * A file system wrapper that records in a `ResolveCache` the directories searched.
+ * The last write time is taken before each search, so concurrent changes invalidate the result.
+ * It can be used by resolutions that search in parallel.
+ */
+class ResolveCacheRecorder final : public FileSystem
+{
+public:
+    ResolveCacheRecorder(const FileSystem& fs, ResolveCache& cache);
+
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override;
+    Optional<uint64_t> GetLastWriteTime(StrView path) const override;
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override;
+    DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const override;
+private:
+    const FileSystem& m_fs;
+    ResolveCache& m_cache;
+    mutable std::mutex m_mutex;
+};
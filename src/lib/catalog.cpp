@@ -0,0 +1,119 @@
+#include "../framework.hpp"
+
+constexpr uint32_t CATALOG_MAGIC   = 0x4B4E4C45; // "ELNK"
+constexpr uint32_t CATALOG_VERSION = 1;
+
+Catalog::Catalog(StrView path)
+{
+    // The file can be replaced while mapped, since it is shared for deletion.
+    const auto hFile = CreateFileW(String(path).data(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+    LARGE_INTEGER size { };
+    HANDLE hMapping = nullptr;
+    if (GetFileSizeEx(hFile, &size) && size.QuadPart >= (LONGLONG)sizeof(Header) && size.QuadPart <= UINT_MAX)
+        hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(hFile);
+    if (!hMapping) return;
+    const auto view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+    if (!view) return;
+
+    // Validate the header, so the lookups only have to check the entry bounds.
+    const auto header = (const Header*)view;
+    const auto required = sizeof(Header) + (uint64_t)header->count * sizeof(Entry) + (uint64_t)header->length * sizeof(wchar_t);
+    if (header->magic != CATALOG_MAGIC || header->version != CATALOG_VERSION || required > (uint64_t)size.QuadPart)
+    {
+        UnmapViewOfFile(view);
+        return;
+    }
+    m_header = header;
+    m_entries = (const Entry*)(header + 1);
+    m_pool = (PCWSTR)(m_entries + header->count);
+}
+
+Catalog::~Catalog()
+{
+    if (m_header)
+        UnmapViewOfFile(m_header);
+}
+
+size_t Catalog::Size() const
+{
+    return m_header ? m_header->count : 0;
+}
+
+// Returns the configuration text of the shim with the specified name.
+Optional<StrView> Catalog::Find(StrView name) const
+{
+    if (!m_header) return std::nullopt;
+    // The names are stored in upper case, so they compare like the name folded.
+    const auto end = m_entries + m_header->count;
+    const auto it = std::lower_bound(m_entries, end, name,
+        [&](const Entry& entry, StrView name) -> bool {
+            return StrCompare(Text(entry.name, entry.nameLength), name, true) < 0;
+        }
+    );
+    if (it == end || !StrEqual(Text(it->name, it->nameLength), name, true))
+        return std::nullopt;
+    return Text(it->config, it->configLength);
+}
+
+Catalog::operator bool() const
+{
+    return m_header != nullptr;
+}
+
+/**
+ * Writes the configurations to a catalog file, replacing it atomically.
+ * Format: <header> <entry>... <string pool>
+ */
+DWORD Catalog::Write(StrView path, const Vector<std::pair<String, Config>>& configs)
+{
+    Vector<std::pair<String, String>> items; // name, config
+    items.reserve(configs.size());
+    for (const auto& [name, config] : configs)
+        items.emplace_back(StrFoldCase(name), config.ToString());
+    std::ranges::sort(items);
+    if (std::ranges::adjacent_find(items, {}, &std::pair<String, String>::first) != items.end())
+        return ERROR_DUP_NAME;
+
+    Vector<Entry> entries;
+    String pool;
+    for (const auto& [name, config] : items)
+    {
+        entries.push_back({ (uint32_t)pool.size(), (uint32_t)name.size(), 0, (uint32_t)config.size() });
+        pool += name;
+        entries.back().config = (uint32_t)pool.size();
+        pool += config;
+    }
+    if (pool.size() > UINT_MAX / sizeof(wchar_t))
+        return ERROR_FILE_TOO_LARGE;
+
+    const Header header { CATALOG_MAGIC, CATALOG_VERSION, (uint32_t)entries.size(), (uint32_t)pool.size() };
+    const auto temp = std::format(L"{}.tmp", path);
+    DWORD error = NO_ERROR;
+    {
+        File file(temp, GENERIC_WRITE, 0, CREATE_ALWAYS);
+        if (!file)
+            return GetLastError();
+        if (!file.Write(&header, sizeof(header))
+            || !file.Write(entries.data(), entries.size() * sizeof(Entry))
+            || !file.Write(pool.data(), pool.size() * sizeof(wchar_t)))
+            error = GetLastError();
+    }
+    if (error == NO_ERROR && !MoveFileExW(temp.data(), String(path).data(), MOVEFILE_REPLACE_EXISTING))
+        error = GetLastError();
+    // The temporary file is not left behind; the catalog in place, if any, is kept.
+    if (error != NO_ERROR)
+        DeleteFileW(temp.data());
+    return error;
+}
+
+StrView Catalog::Text(uint32_t offset, uint32_t length) const
+{
+    if ((uint64_t)offset + length > m_header->length)
+        return { };
+    return { m_pool + offset, length };
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+constexpr auto CATALOG_FILE_NAME = L"exelnk.shims";
+
+/**
+ * A read-only registry of shim configurations, memory-mapped from a single file.
+ * Shims that are hard links (or symbolic links) to the same binary share its streams,
+ * so they look up their configuration here by name instead.
+ * The names are stored in upper case and sorted, and looked up with a binary search.
+ */
+class Catalog final
+{
+public:
+    explicit Catalog(StrView path);
+    Catalog(const Catalog&) = delete;
+    Catalog& operator=(const Catalog&) = delete;
+    ~Catalog();
+
+    size_t Size() const;
+    Optional<StrView> Find(StrView name) const;
+
+    operator bool() const;
+
+    static DWORD Write(StrView path, const Vector<std::pair<String, Config>>& configs);
+private:
+    struct Header
+    {
+        uint32_t magic;   // CATALOG_MAGIC
+        uint32_t version; // CATALOG_VERSION
+        uint32_t count;   // number of entries
+        uint32_t length;  // number of characters in the string pool
+    };
+
+    // Offsets and lengths in characters, relative to the string pool.
+    struct Entry
+    {
+        uint32_t name;
+        uint32_t nameLength;
+        uint32_t config;
+        uint32_t configLength;
+    };
+
+    StrView Text(uint32_t offset, uint32_t length) const;
+
+    const Header* m_header = nullptr; // mapped view
+    const Entry* m_entries = nullptr;
+    PCWSTR m_pool = nullptr;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+/**
+ * The subset of the Win32 API used by the portable modules, with the same values, for builds outside Windows.
+ * Outside Windows there is no current directory or environment in the Win32 sense: the functions that
+ * query them fail, so relative paths are not made absolute, and `Environment::Apply()` has no effect.
+ */
+
+#include <cstdint>
+#include <cwctype>
+#include <chrono>
+#include <thread>
+
+using BOOL = int;
+using INT = int;
+using DWORD = uint32_t;
+using LONGLONG = int64_t;
+using WCHAR = wchar_t;
+using PWSTR = wchar_t*;
+using PCWSTR = const wchar_t*;
+using HMODULE = void*; // of `dlopen`
+
+// The calling convention of 32-bit Windows.
+#define __stdcall
+
+constexpr BOOL TRUE = 1;
+constexpr BOOL FALSE = 0;
+constexpr DWORD INFINITE = 0xFFFFFFFF;
+constexpr size_t MAX_PATH = 260;
+constexpr size_t UNICODE_STRING_MAX_CHARS = 32767;
+
+constexpr DWORD NO_ERROR = 0;
+constexpr DWORD ERROR_FILE_NOT_FOUND = 2;
+constexpr DWORD ERROR_PATH_NOT_FOUND = 3;
+constexpr DWORD ERROR_ACCESS_DENIED = 5;
+constexpr DWORD ERROR_INVALID_DATA = 13;
+constexpr DWORD ERROR_NO_MORE_FILES = 18;
+constexpr DWORD ERROR_HANDLE_EOF = 38;
+constexpr DWORD ERROR_INVALID_NAME = 123;
+constexpr DWORD ERROR_MOD_NOT_FOUND = 126;
+constexpr DWORD ERROR_PROC_NOT_FOUND = 127;
+constexpr DWORD ERROR_DIRECTORY = 267;
+constexpr DWORD ERROR_DIRECTORY_NOT_SUPPORTED = 336;
+constexpr DWORD ERROR_IO_PENDING = 997;
+constexpr DWORD ERROR_CANCELLED = 1223;
+constexpr DWORD ERROR_TIMEOUT = 1460;
+constexpr DWORD ERROR_NOT_ENOUGH_QUOTA = 1816;
+constexpr DWORD ERROR_RESOURCE_ENUM_USER_STOP = 15106;
+
+constexpr DWORD INVALID_FILE_ATTRIBUTES = 0xFFFFFFFF;
+constexpr DWORD FILE_ATTRIBUTE_DIRECTORY = 0x10;
+constexpr DWORD FILE_ATTRIBUTE_NORMAL = 0x80;
+
+union LARGE_INTEGER
+{
+    struct { DWORD LowPart; int32_t HighPart; };
+    LONGLONG QuadPart;
+};
+
+struct WIN32_FIND_STREAM_DATA
+{
+    LARGE_INTEGER StreamSize;
+    WCHAR cStreamName[MAX_PATH + 36];
+};
+
+#define LOCALE_NAME_INVARIANT L""
+constexpr DWORD LCMAP_UPPERCASE = 0x200;
+
+inline void Sleep(DWORD milliseconds)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+}
+
+inline int LCMapStringEx(PCWSTR, DWORD, PCWSTR, int, PWSTR, int, void*, void*, intptr_t)
+{
+    return 0;
+}
+
+inline DWORD GetCurrentDirectoryW(DWORD, PWSTR)
+{
+    return 0;
+}
+
+inline DWORD GetEnvironmentVariableW(PCWSTR, PWSTR, DWORD)
+{
+    return 0;
+}
+
+inline BOOL SetEnvironmentVariableW(PCWSTR, PCWSTR)
+{
+    return FALSE;
+}
@@ -0,0 +1,153 @@
+#include "../portable.hpp"
+
+constexpr std::string_view PAYLOAD_MAGIC = "ELNKCFG";
+constexpr uint8_t PAYLOAD_VERSION = 1;
+
+// Removes leading and trailing whitespace.
+static StrView Trim(StrView str)
+{
+    const auto first = str.find_first_not_of(L" \t\r");
+    if (first == str.npos) return { };
+    return str.substr(first, str.find_last_not_of(L" \t\r") - first + 1);
+}
+
+// Splits a `<key>=<value>` line.
+static Optional<std::pair<StrView, StrView>> SplitLine(StrView line)
+{
+    const auto pos = line.find(L'=');
+    if (pos == line.npos) return std::nullopt;
+    const auto key = Trim(line.substr(0, pos));
+    if (key.empty()) return std::nullopt;
+    return std::pair(key, Trim(line.substr(pos + 1)));
+}
+
+Optional<String> Config::Get(StrView key) const
+{
+    const auto it = std::ranges::find_if(m_values,
+        [&](const auto& value) -> bool {
+            return StrEqual(value.first, key, true);
+        }
+    );
+    if (it == m_values.end()) return std::nullopt;
+    return it->second;
+}
+
+void Config::Set(StrView key, StrView value)
+{
+    const auto it = std::ranges::find_if(m_values,
+        [&](const auto& item) -> bool {
+            return StrEqual(item.first, key, true);
+        }
+    );
+    if (it == m_values.end())
+        m_values.emplace_back(key, value);
+    else
+        it->second = value;
+}
+
+// Returns whether the value is read back as is by `Parse`: it has no line break, and no leading or trailing whitespace.
+bool Config::IsValue(StrView value)
+{
+    return value.find(L'\n') == value.npos && Trim(value).size() == value.size();
+}
+
+String Config::ToString() const
+{
+    String text;
+    for (const auto& [key, value] : m_values)
+        text += std::format(L"{}={}\n", key, value);
+    return text;
+}
+
+/**
+ * Format: `ELNKCFG` <version:u8> <length:u32le> <text:utf16le[length]>
+ * The text is the one returned by `ToString()`.
+ */
+std::string Config::ToPayload() const
+{
+    const auto text = ToString();
+    std::string bytes(PAYLOAD_MAGIC);
+    bytes.push_back((char)PAYLOAD_VERSION);
+    for (size_t i = 0; i < 4; ++i)
+        bytes.push_back((char)(text.size() >> i * 8));
+    for (const auto c : text)
+    {
+        bytes.push_back((char)(c & 0xFF));
+        bytes.push_back((char)(c >> 8 & 0xFF));
+    }
+    return bytes;
+}
+
+/**
+ * Format:
+ * ```
+ * <key>=<value>
+ * ...
+ * ```
+ * Empty lines, and lines starting with `;` or `#` are ignored.
+ */
+Optional<Config> Config::Parse(StrView text)
+{
+    Config config;
+    for (const auto part : text | std::views::split(L'\n'))
+    {
+        const auto line = Trim(StrView(part.begin(), part.end()));
+        if (line.empty() || line.starts_with(L';') || line.starts_with(L'#'))
+            continue;
+        const auto pair = SplitLine(line);
+        if (!pair) return std::nullopt;
+        config.Set(pair->first, pair->second);
+    }
+    return config;
+}
+
+// Parses a payload created by `ToPayload()`; the bytes are read one by one, regardless of the platform.
+// The text must fill the rest of the payload: a shorter or longer length, or an odd byte left over, is rejected.
+Optional<Config> Config::ParsePayload(std::string_view bytes)
+{
+    constexpr auto headerSize = PAYLOAD_MAGIC.size() + 5;
+    if (bytes.size() < headerSize || !bytes.starts_with(PAYLOAD_MAGIC) || (uint8_t)bytes[PAYLOAD_MAGIC.size()] != PAYLOAD_VERSION)
+        return std::nullopt;
+    size_t length = 0;
+    for (size_t i = 0; i < 4; ++i)
+        length |= (size_t)(uint8_t)bytes[PAYLOAD_MAGIC.size() + 1 + i] << i * 8;
+    bytes.remove_prefix(headerSize);
+    if (bytes.size() % 2 || length != bytes.size() / 2)
+        return std::nullopt;
+    String text(length, L'\0');
+    for (size_t i = 0; i < length; ++i)
+        text[i] = (wchar_t)((uint8_t)bytes[i * 2] | (uint8_t)bytes[i * 2 + 1] << 8);
+    return Parse(text);
+}
+
+/**
+ * Format:
+ * ```
+ * [<name>]
+ * <key>=<value>
+ * ...
+ * ```
+ * Returns the configuration of each named shim, in order.
+ */
+Optional<Vector<std::pair<String, Config>>> Config::ParseManifest(StrView text)
+{
+    Vector<std::pair<String, Config>> configs;
+    for (const auto part : text | std::views::split(L'\n'))
+    {
+        const auto line = Trim(StrView(part.begin(), part.end()));
+        if (line.empty() || line.starts_with(L';') || line.starts_with(L'#'))
+            continue;
+        if (line.starts_with(L'[') && line.ends_with(L']'))
+        {
+            const auto name = Trim(line.substr(1, line.size() - 2));
+            if (name.empty()) return std::nullopt;
+            configs.emplace_back(name, Config());
+            continue;
+        }
+        const auto pair = SplitLine(line);
+        if (!pair || configs.empty())
+            return std::nullopt;
+        configs.back().second.Set(pair->first, pair->second);
+    }
+    return configs;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+/**
+ * The configuration of a shim: the `file`, `args`, `wdir`, `scmd`, `flags` and `resolve` keys.
+ * Serialized as `<key>=<value>` lines, and grouped in manifests under `[<name>]` sections.
+ * It can also be embedded in the binary as a payload, which is parsed without any system call.
+ * Values are not escaped, so only those accepted by `IsValue` are kept as is by the text form.
+ */
+class Config final
+{
+public:
+    Optional<String> Get(StrView key) const;
+    void Set(StrView key, StrView value);
+    String ToString() const;
+    std::string ToPayload() const;
+
+    static bool IsValue(StrView value);
+    static Optional<Config> Parse(StrView text);
+    static Optional<Config> ParsePayload(std::string_view bytes);
+    static Optional<Vector<std::pair<String, Config>>> ParseManifest(StrView text);
+private:
+    Vector<std::pair<String, String>> m_values; // key, value
+};
@@ -0,0 +1,189 @@
+#include "../portable.hpp"
+#ifdef _WIN32
+#include "system.hpp"
+#else
+#include <dlfcn.h>
+#endif
+
+// Looks up the function by name or `#ordinal`, loading the module if not loaded yet.
+DWORD DllHost::Find(StrView path, StrView function, RUNDLLFN& fn)
+{
+    auto key = StrFoldCase(path);
+    const auto functionKey = std::format(L"{}{}{}", key, L'\0', function);
+    if (const auto it = m_functions.find(functionKey); it != m_functions.end())
+    {
+        fn = it->second;
+        return NO_ERROR;
+    }
+
+#ifdef _WIN32
+    auto& hModule = m_modules[key];
+    if (!hModule && !(hModule = LoadLibraryW(String(path).data())))
+    {
+        const auto error = GetLastError();
+        m_modules.erase(key);
+        return error;
+    }
+
+    FARPROC proc;
+    // Look up by ordinal.
+    if (function.starts_with(L'#'))
+    {
+        auto ord = StrToInt(String(function.substr(1)));
+        if (ord && !IS_INTRESOURCE(*ord)) ord.reset();
+        proc = GetProcAddress(hModule, MAKEINTRESOURCEA(ord.value_or(0)));
+    }
+    // Look up by name.
+    else
+    {
+        #pragma warning(suppress: 4244) // narrow cast (wchar_t → char)
+        const auto name = std::string(function.begin(), function.end());
+        proc = GetProcAddress(hModule, name.data());
+    }
+    if (!proc) return GetLastError();
+#else
+    // Shared objects are found by the rules of `dlopen`, and have no ordinals.
+    auto& hModule = m_modules[key];
+    if (!hModule && !(hModule = dlopen(StrToUtf8(path).data(), RTLD_NOW | RTLD_LOCAL)))
+    {
+        m_modules.erase(key);
+        return ERROR_MOD_NOT_FOUND;
+    }
+    const auto proc = function.starts_with(L'#') ? nullptr : dlsym(hModule, StrToUtf8(function).data());
+    if (!proc) return ERROR_PROC_NOT_FOUND;
+#endif
+
+    fn = (RUNDLLFN)proc;
+    m_functions.emplace(functionKey, fn);
+    return NO_ERROR;
+}
+
+// Calls the function of the request, and returns the error of the lookup and the exit code of the function.
+std::pair<DWORD, DWORD> DllHost::Call(StrView request)
+{
+    auto strings = DecodeRequest(request);
+    if (!strings)
+        return { ERROR_INVALID_DATA, 0 };
+    RUNDLLFN fn;
+    if (const auto error = Find((*strings)[0], (*strings)[1], fn); error != NO_ERROR)
+        return { error, 0 };
+    Vector<PWSTR> argv;
+    for (auto& arg : *strings | std::views::drop(2))
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    return { NO_ERROR, fn((INT)argv.size() - 1, argv.data()) };
+}
+
+String DllHost::EncodeRequest(StrView path, StrView function, std::span<const PWSTR> args)
+{
+    String request(path);
+    request.append(1, L'\0').append(function).append(1, L'\0');
+    for (const auto arg : args)
+        request.append(arg).append(1, L'\0');
+    return request;
+}
+
+// Splits the request into the path, the function and the arguments.
+Optional<Vector<String>> DllHost::DecodeRequest(StrView request)
+{
+    // The request ends with a null character.
+    if (!request.ends_with(L'\0'))
+        return std::nullopt;
+    request.remove_suffix(1);
+    Vector<String> strings;
+    for (const auto part : request | std::views::split(L'\0'))
+        strings.emplace_back(part.begin(), part.end());
+    if (strings.size() < 2 || strings[0].empty() || strings[1].empty())
+        return std::nullopt;
+    return strings;
+}
+
+std::array<std::byte, 2 * sizeof(DWORD)> DllHost::EncodeResponse(DWORD error, DWORD exitCode)
+{
+    const std::array<DWORD, 2> values = { error, exitCode };
+    return std::bit_cast<std::array<std::byte, 2 * sizeof(DWORD)>>(values);
+}
+
+Optional<std::pair<DWORD, DWORD>> DllHost::DecodeResponse(std::span<const std::byte> response)
+{
+    if (response.size() != 2 * sizeof(DWORD))
+        return std::nullopt;
+    std::array<std::byte, 2 * sizeof(DWORD)> bytes;
+    std::ranges::copy(response, bytes.begin());
+    const auto values = std::bit_cast<std::array<DWORD, 2>>(bytes);
+    return std::pair(values[0], values[1]);
+}
+
+#ifdef _WIN32
+// Serves the calls of other processes, one at a time, until the pipe cannot be created.
+DWORD DllHost::Serve()
+{
+    const auto name = GetSessionPipeName(L"dllhost");
+    for (;;)
+    {
+        // Fails if another process owns the name, so calls are not served by an impostor.
+        const auto hPipe = CreateNamedPipeW(name.data(), PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE,
+            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES, 0x1000, 0x10000, 0, nullptr);
+        if (hPipe == INVALID_HANDLE_VALUE)
+            return GetLastError();
+        if (ConnectNamedPipe(hPipe, nullptr) || GetLastError() == ERROR_PIPE_CONNECTED)
+            Handle(hPipe);
+        DisconnectNamedPipe(hPipe);
+        CloseHandle(hPipe);
+    }
+}
+
+/**
+ * Calls the function through a resident host, if there is one.
+ * Returns the error of the lookup, and the exit code of the function; or the error of the pipe,
+ * once the request has been delivered, since the function may have run.
+ * Returns nothing if the request could not be delivered, so the caller can run the function itself.
+ */
+Optional<std::pair<DWORD, DWORD>> DllHost::CallRemote(StrView path, StrView function, std::span<const PWSTR> args)
+{
+    // The host has its own current directory and search path, so the module is located here, as
+    // `LoadLibraryW` would find it: a path relative to the current directory, or a name in the search path.
+    String module;
+    module.resize_and_overwrite(PATH_MAX - 1,
+        [&](wchar_t* ptr, size_t count) -> size_t {
+            const auto length = path.find_first_of(L"\\/") != path.npos
+                ? GetFullPathNameW(String(path).data(), (DWORD)count, ptr, nullptr)
+                : SearchPathW(nullptr, String(path).data(), L".dll", (DWORD)count, ptr, nullptr);
+            return length < count ? length : 0;
+        }
+    );
+    // A module not found is loaded by the caller, which reports the error.
+    if (module.empty())
+        return std::nullopt;
+    const auto request = EncodeRequest(module, function, args);
+
+    const auto hPipe = ConnectPipe(GetSessionPipeName(L"dllhost"));
+    if (hPipe == INVALID_HANDLE_VALUE)
+        return std::nullopt;
+    std::array<std::byte, 2 * sizeof(DWORD)> response;
+    DWORD bytes;
+    if (!WriteFile(hPipe, request.data(), (DWORD)(request.size() * sizeof(wchar_t)), &bytes, nullptr))
+    {
+        CloseHandle(hPipe);
+        return std::nullopt;
+    }
+    const auto result = ReadFile(hPipe, response.data(), (DWORD)response.size(), &bytes, nullptr);
+    const auto error = !result ? GetLastError() : NO_ERROR;
+    CloseHandle(hPipe);
+    if (error != NO_ERROR)
+        return std::pair(error, (DWORD)0);
+    return DecodeResponse(std::span(response).first(bytes)).value_or(std::pair((DWORD)ERROR_INVALID_DATA, (DWORD)0));
+}
+
+DWORD DllHost::Handle(HANDLE hPipe)
+{
+    String request;
+    if (const auto error = ReadMessage(hPipe, request); error != NO_ERROR)
+        return error;
+    const auto [error, exitCode] = Call(request);
+    const auto response = EncodeResponse(error, exitCode);
+    DWORD bytesWritten;
+    return WriteFile(hPipe, response.data(), (DWORD)response.size(), &bytesWritten, nullptr) ? NO_ERROR : GetLastError();
+}
+#endif
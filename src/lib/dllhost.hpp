@@ -0,0 +1,33 @@
+#pragma once
+
+typedef DWORD(__stdcall* RUNDLLFN)(INT, PWSTR[]);
+
+/**
+ * Calls DLL functions (`:DLL:`), keeping the modules loaded and the functions found.
+ * A resident host (`:DLLHOST:`) serves the calls of other processes through a local named pipe,
+ * so repeated calls do not load and initialize the DLL each time.
+ * Request: <path>\0<function>\0<arg>\0...  Response: <error:DWORD> <exit code:DWORD>
+ * Outside Windows, shared objects are loaded with `dlopen`, to test the host without the pipe.
+ */
+class DllHost final
+{
+public:
+    DWORD Find(StrView path, StrView function, RUNDLLFN& fn);
+    std::pair<DWORD, DWORD> Call(StrView request);
+
+    static String EncodeRequest(StrView path, StrView function, std::span<const PWSTR> args);
+    static Optional<Vector<String>> DecodeRequest(StrView request);
+    static std::array<std::byte, 2 * sizeof(DWORD)> EncodeResponse(DWORD error, DWORD exitCode);
+    static Optional<std::pair<DWORD, DWORD>> DecodeResponse(std::span<const std::byte> response);
+
+#ifdef _WIN32
+    DWORD Serve();
+
+    static Optional<std::pair<DWORD, DWORD>> CallRemote(StrView path, StrView function, std::span<const PWSTR> args);
+private:
+    DWORD Handle(HANDLE hPipe);
+#endif
+private:
+    std::unordered_map<String, HMODULE> m_modules;     // case-folded path
+    std::unordered_map<String, RUNDLLFN> m_functions;  // case-folded path, null, function
+};
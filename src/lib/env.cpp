@@ -0,0 +1,137 @@
+#include "../portable.hpp"
+
+void Environment::Set(StrView name, StrView value)
+{
+    auto& variable = Find(name);
+    // A value set after directories were prepended keeps them in front.
+    if (variable.prepend && variable.value)
+        variable.value = std::format(L"{};{}", *variable.value, value);
+    else
+        variable.value = String(value);
+    variable.prepend = false;
+}
+
+void Environment::Unset(StrView name)
+{
+    auto& variable = Find(name);
+    variable.value.reset();
+    variable.prepend = false;
+    variable.removed = true;
+}
+
+void Environment::PrependPath(StrView directories)
+{
+    if (directories.empty()) return;
+    auto& variable = Find(L"PATH");
+    if (!variable.value)
+    {
+        variable.value = String(directories);
+        variable.prepend = !variable.removed;
+    }
+    else
+        variable.value = std::format(L"{};{}", directories, *variable.value);
+}
+
+bool Environment::Empty() const
+{
+    return m_variables.empty();
+}
+
+/**
+ * Returns a copy of the environment block with the changes applied, in a single merge pass.
+ * Relies on the block being sorted by name, as the system creates it; otherwise returns nothing,
+ * and the changes must be applied with `Apply()` instead.
+ */
+Optional<String> Environment::Merge(PCWSTR block) const
+{
+    String result;
+    StrView previous;
+    auto it = m_variables.begin();
+
+    const auto append = [&](StrView name, StrView value) {
+        result.append(name).append(1, L'=').append(value).append(1, L'\0');
+    };
+    // Appends the variables that are not in the block, up to the specified name.
+    const auto appendNew = [&](Optional<StrView> name) {
+        for (; it != m_variables.end() && (!name || StrCompare(it->name, *name, true) < 0); ++it)
+            if (it->value) append(it->name, *it->value);
+    };
+
+    for (auto entry = block; *entry; entry += previous.size() + 1)
+    {
+        const StrView variable(entry);
+        // Names start after the first character, to include the hidden `=C:` variables.
+        const auto name = variable.substr(0, variable.find(L'=', 1));
+        if (StrCompare(name, previous.substr(0, previous.find(L'=', 1)), true) < 0)
+            return std::nullopt;
+        previous = variable;
+        appendNew(name);
+        if (it != m_variables.end() && StrCompare(it->name, name, true) == 0)
+        {
+            if (it->value && it->prepend)
+                append(name, std::format(L"{};{}", *it->value, variable.substr(std::min(name.size() + 1, variable.size()))));
+            else if (it->value)
+                append(name, *it->value);
+            ++it;
+            continue;
+        }
+        result.append(variable).append(1, L'\0');
+    }
+    appendNew(std::nullopt);
+
+    // The block ends with an empty string.
+    if (result.empty())
+        result.append(1, L'\0');
+    return result;
+}
+
+// Applies the changes to the environment of this process, which is inherited by the target.
+void Environment::Apply() const
+{
+    for (const auto& variable : m_variables)
+    {
+        if (variable.value && variable.prepend)
+        {
+            const auto current = GetEnvironmentVariable(variable.name);
+            const auto value = current.empty() ? *variable.value : std::format(L"{};{}", *variable.value, current);
+            SetEnvironmentVariable(variable.name, StrView(value));
+        }
+        else if (variable.value)
+            SetEnvironmentVariable(variable.name, StrView(*variable.value));
+        else
+            SetEnvironmentVariable(variable.name, std::nullopt);
+    }
+}
+
+Environment Environment::Parse(StrView env, StrView path)
+{
+    Environment environment;
+    for (const auto part : env | std::views::split(L'|'))
+    {
+        const StrView item(part.begin(), part.end());
+        if (item.starts_with(L'-'))
+        {
+            if (item.size() > 1)
+                environment.Unset(item.substr(1));
+            continue;
+        }
+        const auto pos = item.find(L'=', 1);
+        if (pos != item.npos)
+            environment.Set(item.substr(0, pos), item.substr(pos + 1));
+    }
+    environment.PrependPath(path);
+    return environment;
+}
+
+Environment::Variable& Environment::Find(StrView name)
+{
+    const auto it = std::ranges::lower_bound(m_variables, name,
+        [](StrView n1, StrView n2) -> bool {
+            return StrCompare(n1, n2, true) < 0;
+        },
+        &Variable::name
+    );
+    if (it != m_variables.end() && StrCompare(it->name, name, true) == 0)
+        return *it;
+    return *m_variables.insert(it, { .name = String(name) });
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * Changes made to the environment of the target process: variables set or removed,
+ * and directories prepended to `PATH`.
+ * Parsed from the `env` (`<name>=<value>|-<name>|...`) and `path` (`<dir>;<dir>;...`) keys.
+ */
+class Environment final
+{
+public:
+    void Set(StrView name, StrView value);
+    void Unset(StrView name);
+    void PrependPath(StrView directories);
+    bool Empty() const;
+
+    Optional<String> Merge(PCWSTR block) const;
+    void Apply() const;
+
+    static Environment Parse(StrView env, StrView path);
+private:
+    struct Variable
+    {
+        String name;
+        Optional<String> value = { }; // removed if not set
+        bool prepend = false;   // prepend the value to the current one (`PATH`)
+        bool removed = false;   // removed with `-<name>`, so directories prepended later replace the current value
+    };
+
+    Variable& Find(StrView name);
+
+    Vector<Variable> m_variables; // sorted by name, case-insensitive
+};
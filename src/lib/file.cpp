@@ -74,6 +74,21 @@ Optional<String> File::ReadText(StrView path)
     if (r) return str; return std::nullopt;
 }
 
+Optional<std::string> File::ReadBytes(StrView path)
+{
+    std::string bytes;
+    Optional<size_t> r;
+    if (File file(path); file)
+        bytes.resize_and_overwrite(
+            file.Size().value_or(0),
+            [&](char* ptr, size_t count) -> size_t {
+                r = file.Read(ptr, count);
+                return r.value_or(0);
+            }
+        );
+    if (r) return bytes; return std::nullopt;
+}
+
 Optional<size_t> File::WriteText(StrView path, StrView text)
 {
     if (File file(path, GENERIC_WRITE, 0, CREATE_ALWAYS); file)
@@ -20,6 +20,7 @@ public:
     operator bool() const;
 
     static Optional<String> ReadText(StrView path);
+    static Optional<std::string> ReadBytes(StrView path);
     static Optional<size_t> WriteText(StrView path, StrView text);
 private:
     HANDLE m_hFile = nullptr;
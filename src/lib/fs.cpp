@@ -0,0 +1,573 @@
+#include "../portable.hpp"
+#ifdef _WIN32
+#include "system.hpp"
+#else
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+// Copies the name into a fixed-size, null-terminated buffer.
+template <size_t N>
+static void CopyName(wchar_t (&buffer)[N], StrView name)
+{
+    const auto count = std::min(name.size(), N - 1);
+    std::ranges::copy(name.substr(0, count), buffer);
+    buffer[count] = L'\0';
+}
+
+bool FileSystem::Exists(StrView path) const
+{
+    DWORD attributes;
+    return GetAttributes(path, attributes) == NO_ERROR;
+}
+
+#ifdef _WIN32
+const FileSystem& FileSystem::Native()
+{
+    static const NativeFileSystem fs;
+    return fs;
+}
+
+DWORD NativeFileSystem::GetAttributes(StrView path, DWORD& attributes) const
+{
+    attributes = GetFileAttributesW(String(path).data());
+    return attributes == INVALID_FILE_ATTRIBUTES ? GetLastError() : NO_ERROR;
+}
+
+Optional<uint64_t> NativeFileSystem::GetLastWriteTime(StrView path) const
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(String(path).data(), GetFileExInfoStandard, &data))
+        return std::nullopt;
+    return (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime;
+}
+
+DWORD NativeFileSystem::EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const
+{
+    return ::EnumerateFiles(path, fn);
+}
+
+DWORD NativeFileSystem::EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const
+{
+    return ::EnumerateStreams(path, fn);
+}
+#else
+const FileSystem& FileSystem::Native()
+{
+    static const PosixFileSystem fs;
+    return fs;
+}
+
+static DWORD ErrnoToError(int error)
+{
+    switch (error)
+    {
+    case ENOENT: return ERROR_FILE_NOT_FOUND;
+    case ENOTDIR: return ERROR_PATH_NOT_FOUND;
+    case EACCES: case EPERM: return ERROR_ACCESS_DENIED;
+    case ENAMETOOLONG: return ERROR_INVALID_NAME;
+    default: return ERROR_INVALID_DATA;
+    }
+}
+
+static DWORD ModeToAttributes(mode_t mode)
+{
+    return S_ISDIR(mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+}
+
+PosixFileSystem::PosixFileSystem(std::string root)
+    : m_root(std::move(root))
+{
+    while (m_root.ends_with('/'))
+        m_root.pop_back();
+}
+
+// Returns the path of the first `nseg` segments, under the root directory.
+std::string PosixFileSystem::ToNative(StrView path, int64_t nseg) const
+{
+    const Path p(path);
+    auto native = m_root;
+    const auto total = (int64_t)p.SegmentCount();
+    const auto count = (size_t)std::clamp<int64_t>(nseg < 0 ? total + nseg : nseg, 0, total);
+    for (size_t i = 0; i < count; ++i)
+        native.append(1, '/').append(StrToUtf8(p.Segment(i)));
+    return native.empty() ? "/" : native;
+}
+
+// A missing item is `ERROR_FILE_NOT_FOUND` if its directory exists, `ERROR_PATH_NOT_FOUND` otherwise.
+DWORD PosixFileSystem::GetAttributes(StrView path, DWORD& attributes) const
+{
+    attributes = INVALID_FILE_ATTRIBUTES;
+    struct stat st;
+    if (fstatat(AT_FDCWD, ToNative(path).c_str(), &st, 0) == 0)
+    {
+        attributes = ModeToAttributes(st.st_mode);
+        return NO_ERROR;
+    }
+    const auto error = ErrnoToError(errno);
+    if (error != ERROR_FILE_NOT_FOUND)
+        return error;
+    return fstatat(AT_FDCWD, ToNative(path, -1).c_str(), &st, 0) == 0 && S_ISDIR(st.st_mode) ? ERROR_FILE_NOT_FOUND : ERROR_PATH_NOT_FOUND;
+}
+
+Optional<uint64_t> PosixFileSystem::GetLastWriteTime(StrView path) const
+{
+    struct stat st;
+    if (fstatat(AT_FDCWD, ToNative(path).c_str(), &st, 0) != 0)
+        return std::nullopt;
+    return (uint64_t)st.st_mtim.tv_sec * 1000000000 + (uint64_t)st.st_mtim.tv_nsec;
+}
+
+// Matches an entry of a listing, and passes it to the callback. Returns `ERROR_NO_MORE_FILES` to continue.
+static DWORD VisitEntry(int fd, const char* entry, unsigned char type, StrView pattern, String& name, bool& found,
+    const Function<DWORD(const FileEntry&)>& fn)
+{
+    const std::string_view bytes(entry);
+    if (bytes == "." || bytes == "..")
+        return ERROR_NO_MORE_FILES;
+    StrFromUtf8(bytes, name);
+    if (!WildcardMatch(pattern, name))
+        return ERROR_NO_MORE_FILES;
+    // The type is only queried if the directory does not report it.
+    DWORD attributes;
+    struct stat st;
+    if (type == DT_DIR)
+        attributes = FILE_ATTRIBUTE_DIRECTORY;
+    else if (type != DT_LNK && type != DT_UNKNOWN)
+        attributes = FILE_ATTRIBUTE_NORMAL;
+    else if (fstatat(fd, entry, &st, 0) == 0)
+        attributes = ModeToAttributes(st.st_mode);
+    else return ERROR_NO_MORE_FILES; // a broken link
+    found = true;
+    const auto error = fn({ name, attributes });
+    return error != NO_ERROR ? error : ERROR_NO_MORE_FILES;
+}
+
+#ifdef __linux__
+// The record returned by `getdents64`, which glibc declares only in recent versions.
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+/**
+ * Lists the directory, and matches the last segment against each name; symbolic links are followed.
+ * On Linux, the entries are read with `getdents64` in batches of up to 32 KiB, into a buffer reused
+ * by the listings of the thread, and the names are passed to the callback without another copy.
+ */
+DWORD PosixFileSystem::EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const
+{
+    constexpr size_t bufferSize = 0x8000;
+    // A listing started from the callback takes another buffer.
+    static thread_local std::unique_ptr<uint64_t[]> cached;
+
+    const Path p(path);
+    const auto fd = open(ToNative(path, -1).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        const auto error = ErrnoToError(errno);
+        return error == ERROR_FILE_NOT_FOUND ? ERROR_PATH_NOT_FOUND : error;
+    }
+    auto buffer = cached ? std::move(cached) : std::make_unique<uint64_t[]>(bufferSize / sizeof(uint64_t));
+    DWORD error = ERROR_NO_MORE_FILES;
+    bool found = false;
+    String name;
+    while (error == ERROR_NO_MORE_FILES)
+    {
+        const auto size = syscall(SYS_getdents64, fd, buffer.get(), bufferSize);
+        if (size <= 0)
+        {
+            if (size < 0) error = ErrnoToError(errno);
+            break;
+        }
+        const auto bytes = (const char*)buffer.get();
+        for (long offset = 0; offset < size && error == ERROR_NO_MORE_FILES; )
+        {
+            const auto entry = (const LinuxDirent64*)(bytes + offset);
+            error = VisitEntry(fd, entry->d_name, entry->d_type, p.Name(), name, found, fn);
+            offset += entry->d_reclen;
+        }
+    }
+    close(fd);
+    cached = std::move(buffer);
+    if (error != ERROR_NO_MORE_FILES)
+        return error;
+    return found ? ERROR_NO_MORE_FILES : ERROR_FILE_NOT_FOUND;
+}
+#else
+// Lists the directory, and matches the last segment against each name; symbolic links are followed.
+DWORD PosixFileSystem::EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const
+{
+    const Path p(path);
+    const auto dir = opendir(ToNative(path, -1).c_str());
+    if (!dir)
+    {
+        const auto error = ErrnoToError(errno);
+        return error == ERROR_FILE_NOT_FOUND ? ERROR_PATH_NOT_FOUND : error;
+    }
+    DWORD error = ERROR_NO_MORE_FILES;
+    bool found = false;
+    String name;
+    while (error == ERROR_NO_MORE_FILES)
+    {
+        errno = 0;
+        const auto entry = readdir(dir);
+        if (!entry)
+        {
+            if (errno) error = ErrnoToError(errno);
+            break;
+        }
+        error = VisitEntry(dirfd(dir), entry->d_name, entry->d_type, p.Name(), name, found, fn);
+    }
+    closedir(dir);
+    if (error != ERROR_NO_MORE_FILES)
+        return error;
+    return found ? ERROR_NO_MORE_FILES : ERROR_FILE_NOT_FOUND;
+}
+#endif
+
+DWORD PosixFileSystem::EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const
+{
+    DWORD attributes;
+    if (const auto error = GetAttributes(path, attributes); error != NO_ERROR)
+        return error;
+    if (BITALL(attributes, FILE_ATTRIBUTE_DIRECTORY))
+        return ERROR_HANDLE_EOF;
+    WIN32_FIND_STREAM_DATA data { };
+    CopyName(data.cStreamName, L"::$DATA");
+    if (const auto error = fn(&data); error != NO_ERROR)
+        return error;
+    return ERROR_HANDLE_EOF;
+}
+#endif
+
+MemoryFileSystem::MemoryFileSystem()
+    : m_root { .attributes = FILE_ATTRIBUTE_DIRECTORY, .lastWriteTime = 0 }
+{
+}
+
+void MemoryFileSystem::AddFile(StrView path, Vector<String> streams)
+{
+    Create(path, FILE_ATTRIBUTE_NORMAL).streams = std::move(streams);
+}
+
+void MemoryFileSystem::AddDirectory(StrView path)
+{
+    Create(path, FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool MemoryFileSystem::Remove(StrView path)
+{
+    const Path p(path);
+    if (!p.SegmentCount())
+        return false;
+    auto parent = const_cast<Node*>(Find(p.ToString(-1)));
+    if (!parent) return false;
+    const auto removed = std::erase_if(parent->children,
+        [&](const Node& node) -> bool {
+            return StrEqual(node.name, p.Name(), true);
+        }
+    );
+    if (removed) parent->lastWriteTime = ++m_clock;
+    return removed != 0;
+}
+
+/**
+ * Creates a synthetic tree under the specified directory.
+ * Each level contains `fanout` directories named `1.0`, `2.0`, ...;
+ * each directory at the last level contains a file with the specified name.
+ * Returns the number of entries created.
+ */
+size_t MemoryFileSystem::Generate(StrView path, size_t depth, size_t fanout, StrView fileName)
+{
+    return Generate(Create(path, FILE_ATTRIBUTE_DIRECTORY), depth, fanout, fileName);
+}
+
+// Simulates a high-latency volume, such as a network share.
+void MemoryFileSystem::SetLatency(DWORD milliseconds)
+{
+    m_latency = milliseconds;
+}
+
+DWORD MemoryFileSystem::GetAttributes(StrView path, DWORD& attributes) const
+{
+    if (m_latency) Sleep(m_latency);
+    const auto node = Find(path);
+    attributes = node ? node->attributes : INVALID_FILE_ATTRIBUTES;
+    if (node) return NO_ERROR;
+    const auto parent = Find(Path(path).ToString(-1));
+    return parent && BITALL(parent->attributes, FILE_ATTRIBUTE_DIRECTORY) ? ERROR_FILE_NOT_FOUND : ERROR_PATH_NOT_FOUND;
+}
+
+Optional<uint64_t> MemoryFileSystem::GetLastWriteTime(StrView path) const
+{
+    if (m_latency) Sleep(m_latency);
+    if (const auto node = Find(path))
+        return node->lastWriteTime;
+    return std::nullopt;
+}
+
+DWORD MemoryFileSystem::EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const
+{
+    if (m_latency) Sleep(m_latency);
+    const Path p(path);
+    const auto parent = Find(p.ToString(-1));
+    if (!parent || !BITALL(parent->attributes, FILE_ATTRIBUTE_DIRECTORY))
+        return ERROR_PATH_NOT_FOUND;
+    bool found = false;
+    for (const auto& node : parent->children)
+    {
+        if (!WildcardMatch(p.Name(), node.name, true))
+            continue;
+        found = true;
+        if (const auto error = fn({ node.name, node.attributes }); error != NO_ERROR)
+            return error;
+    }
+    return found ? ERROR_NO_MORE_FILES : ERROR_FILE_NOT_FOUND;
+}
+
+DWORD MemoryFileSystem::EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const
+{
+    if (m_latency) Sleep(m_latency);
+    const auto node = Find(path);
+    if (!node) return ERROR_FILE_NOT_FOUND;
+    WIN32_FIND_STREAM_DATA data { };
+    // Files have an unnamed default data stream.
+    if (!BITALL(node->attributes, FILE_ATTRIBUTE_DIRECTORY))
+    {
+        CopyName(data.cStreamName, L"::$DATA");
+        if (const auto error = fn(&data); error != NO_ERROR)
+            return error;
+    }
+    else if (node->streams.empty())
+        return ERROR_HANDLE_EOF;
+    for (const auto& stream : node->streams)
+    {
+        CopyName(data.cStreamName, std::format(L":{}:$DATA", stream));
+        if (const auto error = fn(&data); error != NO_ERROR)
+            return error;
+    }
+    return ERROR_HANDLE_EOF;
+}
+
+const MemoryFileSystem::Node* MemoryFileSystem::Find(StrView path) const
+{
+    const Path p(path);
+    auto node = &m_root;
+    for (size_t i = 0; node && i < p.SegmentCount(); ++i)
+    {
+        const auto it = std::ranges::find_if(node->children,
+            [&](const Node& child) -> bool {
+                return StrEqual(child.name, p.Segment(i), true);
+            }
+        );
+        node = it == node->children.end() ? nullptr : &*it;
+    }
+    return node;
+}
+
+MemoryFileSystem::Node& MemoryFileSystem::Create(StrView path, DWORD attributes)
+{
+    const Path p(path);
+    auto node = &m_root;
+    for (size_t i = 0; i < p.SegmentCount(); ++i)
+    {
+        const auto isLast = i == p.SegmentCount() - 1;
+        auto it = std::ranges::find_if(node->children,
+            [&](const Node& child) -> bool {
+                return StrEqual(child.name, p.Segment(i), true);
+            }
+        );
+        if (it == node->children.end())
+        {
+            node->lastWriteTime = ++m_clock;
+            it = node->children.insert(node->children.end(), Node {
+                .name = String(p.Segment(i)),
+                .attributes = isLast ? attributes : FILE_ATTRIBUTE_DIRECTORY,
+                .lastWriteTime = m_clock
+            });
+        }
+        node = &*it;
+    }
+    return *node;
+}
+
+size_t MemoryFileSystem::Generate(Node& node, size_t depth, size_t fanout, StrView fileName)
+{
+    node.lastWriteTime = ++m_clock;
+    if (!depth)
+    {
+        node.children.push_back({ .name = String(fileName), .attributes = FILE_ATTRIBUTE_NORMAL, .lastWriteTime = m_clock });
+        return 1;
+    }
+    size_t count = fanout;
+    node.children.reserve(node.children.size() + fanout);
+    for (size_t i = 1; i <= fanout; ++i)
+    {
+        node.children.push_back({ .name = std::format(L"{}.0", i), .attributes = FILE_ATTRIBUTE_DIRECTORY, .lastWriteTime = m_clock });
+        count += Generate(node.children.back(), depth - 1, fanout, fileName);
+    }
+    return count;
+}
+
+MemoFileSystem::MemoFileSystem(const FileSystem& fs)
+    : m_fs(fs)
+{
+}
+
+size_t MemoFileSystem::Hits() const
+{
+    return m_hits;
+}
+
+size_t MemoFileSystem::NegativeHits() const
+{
+    return m_negativeHits;
+}
+
+size_t MemoFileSystem::Misses() const
+{
+    return m_misses;
+}
+
+DWORD MemoFileSystem::GetAttributes(StrView path, DWORD& attributes) const
+{
+    {
+        std::scoped_lock lock(m_mutex);
+        if (const auto it = m_attributes.find(path); it != m_attributes.end())
+        {
+            ++m_hits;
+            if (it->second.first != NO_ERROR)
+                ++m_negativeHits;
+            attributes = it->second.second;
+            return it->second.first;
+        }
+    }
+    ++m_misses;
+    const auto error = m_fs.GetAttributes(path, attributes);
+    // Other errors may be transient (access denied, network failures), and are not kept.
+    if (error == NO_ERROR || error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND)
+    {
+        std::scoped_lock lock(m_mutex);
+        m_attributes.emplace(m_paths.Intern(path), std::pair(error, attributes));
+    }
+    return error;
+}
+
+Optional<uint64_t> MemoFileSystem::GetLastWriteTime(StrView path) const
+{
+    return m_fs.GetLastWriteTime(path);
+}
+
+DWORD MemoFileSystem::EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const
+{
+    std::shared_ptr<const Listing> listing;
+    {
+        std::scoped_lock lock(m_mutex);
+        if (const auto it = m_listings.find(path); it != m_listings.end())
+            listing = it->second;
+    }
+    if (listing)
+    {
+        ++m_hits;
+        if (listing->error != ERROR_NO_MORE_FILES)
+            ++m_negativeHits;
+    }
+    else
+    {
+        ++m_misses;
+        auto entries = std::make_shared<Listing>();
+        entries->error = m_fs.EnumerateFiles(path,
+            [&](const FileEntry& entry) -> DWORD {
+                entries->names += entry.name;
+                entries->entries.emplace_back((uint32_t)entries->names.size(), entry.attributes);
+                return NO_ERROR;
+            }
+        );
+        listing = entries;
+        // Other errors may be transient (access denied, network failures), and are not kept.
+        if (listing->error == ERROR_NO_MORE_FILES
+            || listing->error == ERROR_FILE_NOT_FOUND
+            || listing->error == ERROR_PATH_NOT_FOUND)
+        {
+            std::scoped_lock lock(m_mutex);
+            m_listings.emplace(m_paths.Intern(path), listing);
+        }
+    }
+    // Replay the listing, with views of the names kept.
+    const StrView names = listing->names;
+    uint32_t start = 0;
+    for (const auto& [end, attributes] : listing->entries)
+    {
+        if (const auto error = fn({ names.substr(start, end - start), attributes }); error != NO_ERROR)
+            return error;
+        start = end;
+    }
+    return listing->error;
+}
+
+DWORD MemoFileSystem::EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const
+{
+    return m_fs.EnumerateStreams(path, fn);
+}
+
+MaskFileSystem::MaskFileSystem(const FileSystem& fs, StrView path)
+    : m_fs(fs)
+{
+    const Path item(path);
+    String stream;
+    m_path = item.ToString(item.SegmentCount(), &stream);
+    m_name = item.Name();
+    if (const auto index = m_name.find(L':'); index != m_name.npos)
+        m_name.resize(index);
+}
+
+bool MaskFileSystem::IsHidden(StrView path) const
+{
+    if (!path.empty() && path.back() == L'\\')
+        path.remove_suffix(1);
+    return StrEqual(path, m_path, true)
+        || (path.size() > m_path.size() && path[m_path.size()] == L':' && StrEqual(path.substr(0, m_path.size()), m_path, true));
+}
+
+DWORD MaskFileSystem::GetAttributes(StrView path, DWORD& attributes) const
+{
+    if (!IsHidden(path))
+        return m_fs.GetAttributes(path, attributes);
+    attributes = INVALID_FILE_ATTRIBUTES;
+    return ERROR_FILE_NOT_FOUND;
+}
+
+Optional<uint64_t> MaskFileSystem::GetLastWriteTime(StrView path) const
+{
+    return IsHidden(path) ? std::nullopt : m_fs.GetLastWriteTime(path);
+}
+
+// The entries of the directory of the hidden item are listed without it.
+DWORD MaskFileSystem::EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const
+{
+    const auto directory = path.substr(0, path.find_last_of(L'\\'));
+    const auto parent = StrView(m_path).substr(0, m_path.size() - m_name.size() - 1);
+    if (!StrEqual(directory, parent, true))
+        return m_fs.EnumerateFiles(path, fn);
+    return m_fs.EnumerateFiles(path,
+        [&](const FileEntry& entry) -> DWORD {
+            return StrEqual(entry.name, m_name, true) ? NO_ERROR : fn(entry);
+        }
+    );
+}
+
+DWORD MaskFileSystem::EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const
+{
+    return IsHidden(path) ? ERROR_FILE_NOT_FOUND : m_fs.EnumerateStreams(path, fn);
+}
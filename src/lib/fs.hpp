@@ -0,0 +1,152 @@
+#pragma once
+
+/**
+ * File system backend used by the path resolution engine.
+ * The native implementation calls the Win32 API, or the POSIX API on other platforms; the in-memory implementation provides
+ * a synthetic tree, which allows measuring and testing the search without a real volume.
+ * Queries return a system error code, `ERROR_FILE_NOT_FOUND` or `ERROR_PATH_NOT_FOUND` for missing items.
+ */
+class FileSystem
+{
+public:
+    virtual ~FileSystem() = default;
+
+    virtual DWORD GetAttributes(StrView path, DWORD& attributes) const = 0;
+    virtual Optional<uint64_t> GetLastWriteTime(StrView path) const = 0;
+    virtual DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const = 0;
+    virtual DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const = 0;
+
+    bool Exists(StrView path) const;
+
+    static const FileSystem& Native();
+};
+
+#ifdef _WIN32
+class NativeFileSystem final : public FileSystem
+{
+public:
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override;
+    Optional<uint64_t> GetLastWriteTime(StrView path) const override;
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override;
+    DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const override;
+};
+#else
+/**
+ * The file system of other platforms, through `opendir`/`readdir` (`getdents64` on Linux) and `fstatat`.
+ * The volume part of the paths (drive letter, UNC server and share) is replaced by the root directory,
+ * so `C:\usr\bin` is `/usr/bin` by default. Names are converted from and to UTF-8, and matched case-sensitively.
+ * Files only have the default data stream.
+ */
+class PosixFileSystem final : public FileSystem
+{
+public:
+    explicit PosixFileSystem(std::string root = "/");
+
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override;
+    Optional<uint64_t> GetLastWriteTime(StrView path) const override;
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override;
+    DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const override;
+private:
+    std::string ToNative(StrView path, int64_t nseg = INT64_MAX) const;
+
+    std::string m_root; // without the trailing separator
+};
+#endif
+
+/**
+ * A file system tree stored in memory.
+ * The volume part of the paths (drive letter, UNC server and share) is ignored.
+ * Supports `*` and `?` wildcards in the last path segment.
+ */
+class MemoryFileSystem final : public FileSystem
+{
+public:
+    MemoryFileSystem();
+
+    void AddFile(StrView path, Vector<String> streams = { });
+    void AddDirectory(StrView path);
+    bool Remove(StrView path);
+    size_t Generate(StrView path, size_t depth, size_t fanout, StrView fileName);
+    void SetLatency(DWORD milliseconds);
+
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override;
+    Optional<uint64_t> GetLastWriteTime(StrView path) const override;
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override;
+    DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const override;
+private:
+    struct Node
+    {
+        String name = { };
+        DWORD attributes = 0;
+        uint64_t lastWriteTime = 0;
+        Vector<String> streams = { }; // alternate data stream names
+        Vector<Node> children = { };
+    };
+
+    const Node* Find(StrView path) const;
+    Node& Create(StrView path, DWORD attributes);
+    size_t Generate(Node& node, size_t depth, size_t fanout, StrView fileName);
+
+    Node m_root;
+    uint64_t m_clock = 0;   // last write time source
+    DWORD m_latency = 0;    // simulated latency of each call, in milliseconds
+};
+
+/**
+ * A file system wrapper that keeps the directory listings and attributes queried,
+ * including those not found, and serves repeated queries from memory.
+ * Queries are keyed by their path, compared case-insensitively; a listing is read in full on the first query.
+ * It is meant to be short-lived, since changes made after a query are not seen.
+ * It can be used by resolutions that search in parallel.
+ */
+class MemoFileSystem final : public FileSystem
+{
+public:
+    explicit MemoFileSystem(const FileSystem& fs);
+
+    size_t Hits() const;
+    size_t NegativeHits() const;
+    size_t Misses() const;
+
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override;
+    Optional<uint64_t> GetLastWriteTime(StrView path) const override;
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override;
+    DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const override;
+private:
+    struct Listing
+    {
+        DWORD error; // ERROR_NO_MORE_FILES | ERROR_FILE_NOT_FOUND | ERROR_PATH_NOT_FOUND
+        String names; // names of the entries, one after the other
+        Vector<std::pair<uint32_t, DWORD>> entries; // end of the name in `names`, attributes
+    };
+
+    const FileSystem& m_fs;
+    mutable std::mutex m_mutex;
+    mutable StrInterner m_paths; // keys of the listings and attributes
+    mutable std::unordered_map<StrView, std::shared_ptr<const Listing>, StrFoldHash, StrFoldEqual> m_listings;
+    mutable std::unordered_map<StrView, std::pair<DWORD, DWORD>, StrFoldHash, StrFoldEqual> m_attributes; // error, attributes
+    mutable std::atomic<size_t> m_hits = 0;
+    mutable std::atomic<size_t> m_negativeHits = 0; // hits of queries not found
+    mutable std::atomic<size_t> m_misses = 0;
+};
+
+/**
+ * A file system wrapper that hides an item, and its data streams.
+ * Resolving a pattern again with its match hidden finds whether it has another match.
+ */
+class MaskFileSystem final : public FileSystem
+{
+public:
+    MaskFileSystem(const FileSystem& fs, StrView path);
+
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override;
+    Optional<uint64_t> GetLastWriteTime(StrView path) const override;
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override;
+    DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const override;
+private:
+    bool IsHidden(StrView path) const;
+
+    const FileSystem& m_fs;
+    String m_path; // hidden item, without the data stream and trailing separator
+    String m_name; // name of the hidden item
+};
@@ -1,4 +1,4 @@
-#include "../framework.hpp"
+#include "../portable.hpp"
 
 #define CREATE_PATH_ABSOLUTE(path, flags) \
     Path(                                 \
@@ -15,6 +15,9 @@
 #define CURRENT_DIRECTORY_FULL_PATH GET_CURRENT_DIRECTORY_PATH(0)
 #define CURRENT_DIRECTORY_ROOT_PATH GET_CURRENT_DIRECTORY_PATH(PATH_FLAG_IGNORE_SEGMENTS)
 
+#define MICROSECONDS_SINCE(start) \
+    (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - (start)).count()
+
 static auto IsRootLocalDeviceDrive(StrView path)
 {
     static std::wregex re(L"^(\\\\|/){2}\\?(\\\\|/)[A-Z]:", std::regex_constants::icase);
@@ -27,6 +30,13 @@ static auto IsRootLocalDeviceUNC(StrView path)
     return std::regex_search(path.begin(), path.end(), re);
 }
 
+// Returns the offset of the data stream in the segment ("name:stream:type"), or `npos`.
+static auto FindStream(StrView segment)
+{
+    const auto index = segment.find_first_of(L':');
+    return index ? index : StrView::npos;
+}
+
 static auto Extract(StrView& path, StrView& name, bool* ews)
 {
     if (path.empty()) return false;
@@ -45,16 +55,11 @@ static auto Extract(StrView& path, StrView& name, bool* ews)
     return true;
 }
 
-static auto Extract(StrView& path)
-{
-    StrView name;
-    Extract(path, name, nullptr);
-    return String(name);
-}
-
 Path::Path(StrView path, uint32_t flags)
     : m_pView(&path)
 {
+    StrView server, root;
+
     if (IsRootLocalDeviceDrive(path))
     {
         path.remove_prefix(4);
@@ -74,13 +79,13 @@ Path::Path(StrView path, uint32_t flags)
             if (At(2) == L'.' && IsSep(3))
             {
                 m_type = PATH_TYPE_DEVICE;
-                m_root = path;
+                m_path = path;
             }
             // Root Local Device.
             else if (At(2) == L'?' && IsSep(3))
             {
                 m_type = PATH_TYPE_ROOT_DEVICE;
-                m_root = path;
+                m_path = path;
             }
             // UNC Absolute.
             else
@@ -88,9 +93,12 @@ Path::Path(StrView path, uint32_t flags)
                 path.remove_prefix(2);
                 __path_type_unc_absolute:
                 m_type = PATH_TYPE_UNC;
-                m_server = Extract(path);
-                m_root = Extract(path);
+                Extract(path, server, nullptr);
+                Extract(path, root, nullptr);
+                m_path = std::format(L"\\\\?\\UNC\\{}\\{}", server, root);
+                m_server = (uint32_t)server.size();
             }
+            m_root = (uint32_t)(IsDevice() ? m_path.size() : root.size());
         }
         // Rooted.
         else if (!BITALL(flags, PATH_FLAG_IGNORE_ROOTED))
@@ -104,12 +112,14 @@ Path::Path(StrView path, uint32_t flags)
         if (At(1) == L':')
         {
             __path_type_drive:
-            m_root = std::format(L"{:c}:", towupper(At(0)));
+            m_root = 2;
+            m_path = std::format(L"{:c}:", towupper(At(0)));
             // Drive Absolute.
             if (!At(2) || IsSep(2))
             {
                 path.remove_prefix(At(2) ? 3 : 2);
                 m_type = PATH_TYPE_DRIVE_ABSOLUTE;
+                m_path.insert(0, L"\\\\?\\");
             }
             // Drive Relative.
             else if (!BITALL(flags, PATH_FLAG_IGNORE_DRIVE_RELATIVE))
@@ -117,14 +127,25 @@ Path::Path(StrView path, uint32_t flags)
                 path.remove_prefix(2);
                 m_type = PATH_TYPE_DRIVE_RELATIVE;
             }
+            else
+            {
+                m_root = 0;
+                m_path.clear();
+            }
         }
         // Relative.
         else if (!BITALL(flags, PATH_FLAG_IGNORE_RELATIVE))
+        {
             m_type = PATH_TYPE_RELATIVE;
+            m_path = L".";
+        }
     }
 
+    m_prefix = (uint32_t)m_path.size();
+    if (IsDevice()) return;
+
     // Parse the path segments.
-    if (!IsDevice() && !BITALL(flags, PATH_FLAG_IGNORE_SEGMENTS))
+    if (!BITALL(flags, PATH_FLAG_IGNORE_SEGMENTS))
     {
         StrView part;
         while (Extract(path, part, &m_endsWithSep))
@@ -132,17 +153,19 @@ Path::Path(StrView path, uint32_t flags)
             if (part == L"..")
             {
                 // Process non-consecutive `..`.
-                if (!m_segments.empty() && m_segments.back() != L"..")
-                    m_segments.pop_back();
+                if (!m_ends.Empty() && Name() != L"..")
+                    PopSegment();
                 // Keep `..` if the path is relative.
                 // They are processed in `MakeAbsolute`.
                 else if (IsRelative())
-                    m_segments.emplace_back(part);
+                    PushSegment(part);
             }
             else if (!part.empty() && part != L".")
-                m_segments.emplace_back(part);
+                PushSegment(part);
         }
     }
+
+    Seal();
 }
 
 uint8_t Path::Type() const
@@ -152,175 +175,648 @@ uint8_t Path::Type() const
 
 StrView Path::Name() const
 {
-    if (m_segments.empty())
+    if (m_ends.Empty())
         return L"";
-    return m_segments.back();
+    return Segment(m_ends.Size() - 1);
+}
+
+StrView Path::Segment(size_t i) const
+{
+    const auto start = SegmentStart(i);
+    return StrView(m_path).substr(start, m_ends[i] - start);
 }
 
+size_t Path::SegmentCount() const
+{
+    return m_ends.Size();
+}
+
+/**
+ * Returns a view of the first `nseg` segments of the path, without copying.
+ * Only the full path (`nseg = INT64_MAX`) is guaranteed to be null-terminated.
+ * If `stream` is specified, the data stream of the last segment is moved into it.
+ */
 StrView Path::ToString(int64_t nseg, String* stream) const
 {
     if (!m_type) return L"";
-    if (IsDevice()) return m_root;
+    if (IsDevice()) return m_path;
 
-    const auto count = ClampIndex(nseg, m_segments.size());
+    if (stream)
+        stream->clear();
 
-    if (m_type == PATH_TYPE_ROOTED)
-        m_path = L"\\";
-    else if (m_type == PATH_TYPE_RELATIVE)
-        m_path = L".";
-    else if (m_type == PATH_TYPE_DRIVE_RELATIVE)
-        m_path = m_root;
-    else if (m_type == PATH_TYPE_DRIVE_ABSOLUTE)
-        m_path = std::format(L"\\\\?\\{}", m_root);
-    else if (m_type == PATH_TYPE_UNC)
-        m_path = std::format(L"\\\\?\\UNC\\{}\\{}", m_server, m_root);
+    const StrView path = m_path;
+    const auto count = ClampIndex(nseg, m_ends.Size());
+
+    // Only the prefix and the first separator, if any.
+    if (!count)
+    {
+        const auto hasSep = m_ends.Empty() || m_type != PATH_TYPE_DRIVE_RELATIVE;
+        return path.substr(0, m_prefix + hasSep);
+    }
+
+    size_t end = m_ends[count - 1];
+
+    if (count == m_ends.Size() && nseg == INT64_MAX && m_endsWithSep)
+        ++end; // trailing separator
 
     if (stream)
-        stream->clear();
+    {
+        const auto segment = Segment(count - 1);
+        const auto index = FindStream(segment);
+        if (index != segment.npos)
+        {
+            *stream = segment.substr(index);
+            end = m_ends[count - 1] - segment.size() + index;
+        }
+    }
+
+    return path.substr(0, end);
+}
+
+// Counters of `PathResolveSegmentStats`, updated by the subtrees searched in parallel.
+struct Path::ResolveCounters
+{
+    std::atomic<size_t> enumerations;
+    std::atomic<size_t> entries;
+    std::atomic<size_t> descents;
+    std::atomic<size_t> backtracks;
+    std::atomic<size_t> streams;
+    std::atomic<size_t> probes;
+    std::atomic<uint64_t> microseconds;
+};
+
+/**
+ * Limits of a resolution, shared by the subtrees searched in parallel.
+ * The search checks them before each entry and backtrack, and stops once one is reached;
+ * a single query that blocks (a slow share) is not interrupted.
+ */
+struct Path::ResolveBudget
+{
+    const PathResolveOptions& options;
+    const std::chrono::steady_clock::time_point deadline;
+    std::atomic<size_t> entries = 0;
+    std::atomic<size_t> backtracks = 0;
+    std::atomic<DWORD> error = NO_ERROR; // first limit reached
+
+    // Counts the work, and returns the error of the first limit reached, if any.
+    DWORD Spend(size_t entryCount, size_t backtrackCount)
+    {
+        if (const auto reached = error.load())
+            return reached;
+        DWORD reached = NO_ERROR;
+        if (options.maxEntries && (entries += entryCount) > options.maxEntries)
+            reached = ERROR_NOT_ENOUGH_QUOTA;
+        else if (options.maxBacktracks && (backtracks += backtrackCount) > options.maxBacktracks)
+            reached = ERROR_NOT_ENOUGH_QUOTA;
+        else if (options.deadline && std::chrono::steady_clock::now() >= deadline)
+            reached = ERROR_TIMEOUT;
+        if (reached == NO_ERROR)
+            return NO_ERROR;
+        DWORD expected = NO_ERROR;
+        error.compare_exchange_strong(expected, reached);
+        return error;
+    }
+};
+
+/**
+ * Scratch storage of the resolution, used by the segments searched by a thread, so the search
+ * does not allocate for each entry once the buffers have grown.
+ * Each frame of the stack owns the end of the buffers, which are truncated when it is removed.
+ */
+struct Path::ResolveArena
+{
+    // A directory entry, with the name in `names`.
+    struct Candidate
+    {
+        uint32_t offset;
+        uint32_t length;
+        DWORD attributes;
+    };
+
+    // A segment being searched: a listing whose candidates are visited in order,
+    // or a run of literal segments, without candidates.
+    struct Frame
+    {
+        size_t segment; // listed segment, or first segment of the run
+        size_t child;   // segment where the search continues below
+        size_t names;   // size of `names` before the frame, followed by the saved child segment
+        size_t saved;   // length of the saved child segment
+        size_t first;   // size of `candidates` before the frame
+        size_t next;    // next candidate to visit
+        DWORD error;    // result once all candidates have been visited; NO_ERROR for the result of the last subtree
+        std::chrono::steady_clock::time_point start;
+    };
+
+    String names;
+    Vector<Candidate> candidates;
+    Vector<Frame> frames;
+
+    Frame& Push(size_t segment, size_t child, StrView saved, std::chrono::steady_clock::time_point start)
+    {
+        const auto size = names.size();
+        names += saved;
+        return frames.emplace_back(segment, child, size, saved.size(), candidates.size(), candidates.size(), NO_ERROR, start);
+    }
+
+    void Pop()
+    {
+        names.resize(frames.back().names);
+        candidates.resize(frames.back().first);
+        frames.pop_back();
+    }
+
+    void Add(const FileEntry& entry)
+    {
+        candidates.push_back({ (uint32_t)names.size(), (uint32_t)entry.name.size(), entry.attributes });
+        names += entry.name;
+    }
+
+    StrView Name(const Candidate& candidate) const
+    {
+        return StrView(names).substr(candidate.offset, candidate.length);
+    }
 
-    for (size_t i = 0; i < count; ++i)
+    StrView Saved(const Frame& frame) const
     {
-        if (i || m_type != PATH_TYPE_DRIVE_RELATIVE)
-            m_path.push_back(L'\\');
-        StrView segment = m_segments[i];
-        if (stream && i == count - 1)
+        return StrView(names).substr(frame.names, frame.saved);
+    }
+};
+
+/**
+ * State of a resolution, shared by the subtrees searched in parallel.
+ * A subtree is cancelled once an earlier candidate of any enclosing fan-out has a result.
+ */
+struct Path::ResolveState
+{
+    const PathResolveOptions& options;
+    std::atomic<uint32_t>& threads;  // spare threads
+    uint32_t fanouts;                // enclosing fan-outs
+    const std::atomic<size_t>* best; // earliest candidate with a result, in the enclosing fan-out
+    size_t index;                    // candidate index, in the enclosing fan-out
+    const ResolveState* parent;
+    ResolveCounters* counters;       // by segment index, if statistics are requested
+    const uint32_t* literals;        // literal segments from each segment index (the plan)
+    ResolveBudget* budget;           // if any limit is set
+    ResolveArena* arena;             // of the current thread
+
+    bool IsCancelled() const
+    {
+        if (options.cancel && options.cancel->load())
+            return true;
+        for (auto state = this; state; state = state->parent)
+            if (state->best && state->best->load() < state->index)
+                return true;
+        return false;
+    }
+};
+
+DWORD Path::Resolve(const PathResolveOptions& options)
+{
+    MakeAbsolute();
+    std::atomic<uint32_t> threads = std::max(options.threads, 1u) - 1;
+
+    // Keep the queries made during this resolution.
+    auto resolveOptions = options;
+    Optional<MemoFileSystem> memo;
+    if (BITALL(options.flags, PATH_RESOLVE_FLAG_MEMO))
+        resolveOptions.fs = &memo.emplace(*options.fs);
+
+    // Count the work done at each segment, only if requested.
+    std::unique_ptr<ResolveCounters[]> counters;
+    if (options.stats)
+        counters = std::make_unique<ResolveCounters[]>(m_ends.Size());
+
+    // Plan the search: each run of literal segments is looked up with a single probe,
+    // and only wildcard segments are listed. A segment with a data stream is listed.
+    Vector<uint32_t> literals(m_ends.Size() + 1);
+    for (auto i = m_ends.Size(); i-- > 0; )
+        if (!IsPattern(Segment(i)) && FindStream(Segment(i)) == StrView::npos)
+            literals[i] = literals[i + 1] + 1;
+
+    const auto start = std::chrono::steady_clock::now();
+    Optional<ResolveBudget> budget;
+    if (options.deadline || options.maxEntries || options.maxBacktracks)
+        budget.emplace(options, start + std::chrono::milliseconds(options.deadline));
+    ResolveArena arena;
+    const auto error = Resolve({ resolveOptions, threads, 0, nullptr, 0, nullptr, counters.get(), literals.data(), budget ? &*budget : nullptr, &arena }, 0);
+
+    if (auto stats = options.stats)
+    {
+        stats->microseconds += MICROSECONDS_SINCE(start);
+        if (memo)
         {
-            const auto index = segment.find_first_of(L':');
-            if (index && index != segment.npos)
-            {
-                *stream = segment.substr(index);
-                segment = segment.substr(0, index);
-            }
+            stats->memoHits += memo->Hits();
+            stats->memoNegativeHits += memo->NegativeHits();
+            stats->memoMisses += memo->Misses();
+        }
+        if (stats->segments.size() < m_ends.Size())
+            stats->segments.resize(m_ends.Size());
+        for (size_t i = 0; i < m_ends.Size(); ++i)
+        {
+            auto& segment = stats->segments[i];
+            segment.enumerations += counters[i].enumerations;
+            segment.entries += counters[i].entries;
+            segment.descents += counters[i].descents;
+            segment.backtracks += counters[i].backtracks;
+            segment.streams += counters[i].streams;
+            segment.probes += counters[i].probes;
+            segment.microseconds += counters[i].microseconds;
         }
-        m_path.append(segment);
     }
+    return error;
+}
 
-    if (!count || (nseg == INT64_MAX && m_endsWithSep))
-        m_path.push_back(L'\\');
+// Result of a step of the search that pushed a frame; the search continues at the child segment of the frame.
+constexpr DWORD RESOLVE_PENDING = ~DWORD(0);
 
-    return m_path;
+/**
+ * Searches from the segment, depth first, with an explicit stack of frames in the arena,
+ * so the native stack does not grow with the number of segments of the path.
+ */
+DWORD Path::Resolve(const ResolveState& state, size_t i)
+{
+    const auto& frames = state.arena->frames;
+    const auto base = frames.size();
+    auto result = Open(state, i);
+    for (;;)
+    {
+        if (result == RESOLVE_PENDING)
+            result = Open(state, frames.back().child);
+        else if (frames.size() == base)
+            return result;
+        else
+            result = Next(state, result);
+    }
+}
+
+// Starts the search at the segment. Returns its result, or `RESOLVE_PENDING` once a frame has been pushed.
+DWORD Path::Open(const ResolveState& state, size_t i)
+{
+    if (i >= m_ends.Size())
+        return NO_ERROR;
+    const auto start = state.counters ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    DWORD result;
+    if (const auto count = state.literals[i])
+        result = Probe(state, i, count, start);
+    else if (i == m_ends.Size() - 1)
+        result = Find(state, i);
+    else
+        result = List(state, i, start);
+    // The time of a frame is counted once it is removed.
+    if (state.counters && result != RESOLVE_PENDING)
+        state.counters[i].microseconds += MICROSECONDS_SINCE(start);
+    return result;
 }
 
-DWORD Path::Resolve(size_t i)
+/**
+ * Returns the result of the subtree below the current candidate to the frame on top, and continues
+ * with its next candidate if no matching items have been found.
+ * Returns `RESOLVE_PENDING`, or the result of the frame once removed.
+ */
+DWORD Path::Next(const ResolveState& state, DWORD result)
 {
-    if (!i) MakeAbsolute();
-    DWORD error = NO_ERROR;
-    if (i < m_segments.size())
+    auto& arena = *state.arena;
+    auto& frame = arena.frames.back();
+    const auto counters = state.counters ? &state.counters[frame.segment] : nullptr;
+    if (result == ERROR_FILE_NOT_FOUND || result == ERROR_NO_MORE_FILES)
     {
-        String stream;
-        const auto currentPath = ToString(i + 1, &stream);
-        const auto isLastSegment = i == m_segments.size() - 1;
-        // The data stream must be specified at the end of the path.
-        if (!stream.empty() && (!isLastSegment || m_endsWithSep))
-            return ERROR_INVALID_NAME;
-        // Start enumerating files and directories.
-        error = EnumerateFiles(currentPath,
-            [&](WIN32_FIND_DATA* pfd) -> DWORD {
-                m_segments[i] = pfd->cFileName;
-                const auto isDirectory = BITALL(pfd->dwFileAttributes, FILE_ATTRIBUTE_DIRECTORY);
-                // Stop enumeration if there are no more segments.
-                if (isLastSegment)
-                {
-                    // If the path ends with a separator, the last item must be a directory.
-                    if (m_endsWithSep && !isDirectory)
-                        return ERROR_DIRECTORY;
-                    // If the path does not specify a data stream.
-                    if (stream.empty())
-                        return ERROR_RESOURCE_ENUM_USER_STOP;
-                    // Directories cannot have a default data stream.
-                    if (isDirectory && (stream == L":" || stream[1] == L':'))
-                        error = ERROR_DIRECTORY_NOT_SUPPORTED;
-                    else
+        if (counters) ++counters->backtracks;
+        Splice(frame.child, 0, StrView::npos, arena.Saved(frame));
+        const auto reached = state.budget ? state.budget->Spend(0, 1) : NO_ERROR;
+        result = reached ? reached : Advance(state, result);
+        if (result == RESOLVE_PENDING)
+            return result;
+    }
+    // Stop if an error has occurred or an item has been found.
+    if (counters) counters->microseconds += MICROSECONDS_SINCE(frame.start);
+    arena.Pop();
+    return result;
+}
+
+/**
+ * Substitutes the segment of the frame on top with its next candidate, and descends into it.
+ * Returns `RESOLVE_PENDING`, or the result of the frame once all candidates have been visited.
+ */
+DWORD Path::Advance(const ResolveState& state, DWORD result)
+{
+    auto& arena = *state.arena;
+    auto& frame = arena.frames.back();
+    if (frame.next == arena.candidates.size())
+        return frame.error ? frame.error : result;
+    if (state.IsCancelled())
+        return ERROR_CANCELLED;
+    Splice(frame.segment, 0, StrView::npos, arena.Name(arena.candidates[frame.next++]));
+    if (state.counters) ++state.counters[frame.segment].descents;
+    return RESOLVE_PENDING;
+}
+
+/**
+ * Lists the directory of a wildcard segment, other than the last one, and pushes a frame
+ * that visits its subdirectories in order, or from the highest version; or searches them in parallel.
+ */
+DWORD Path::List(const ResolveState& state, size_t i, std::chrono::steady_clock::time_point start)
+{
+    const auto& options = state.options;
+    const auto counters = state.counters ? &state.counters[i] : nullptr;
+    auto& arena = *state.arena;
+
+    // The data stream must be specified at the end of the path.
+    if (FindStream(Segment(i)) != StrView::npos)
+        return ERROR_INVALID_NAME;
+
+    // The next segment is overwritten by the subtree search, and must be restored when backtracking.
+    auto& frame = arena.Push(i, i + 1, Segment(i + 1), start);
+    if (counters) ++counters->enumerations;
+    frame.error = options.fs->EnumerateFiles(ToString(i + 1),
+        [&](const FileEntry& entry) -> DWORD {
+            if (counters) ++counters->entries;
+            if (state.budget)
+                if (const auto error = state.budget->Spend(1, 0))
+                    return error;
+            if (BITALL(entry.attributes, FILE_ATTRIBUTE_DIRECTORY))
+                arena.Add(entry);
+            return NO_ERROR;
+        }
+    );
+
+    // The listing is incomplete once a limit is reached.
+    if (state.budget && state.budget->error)
+    {
+        arena.Pop();
+        return state.budget->error;
+    }
+    if (BITALL(options.flags, PATH_RESOLVE_FLAG_RANK))
+        std::sort(arena.candidates.begin() + frame.first, arena.candidates.end(),
+            [&](const ResolveArena::Candidate& c1, const ResolveArena::Candidate& c2) -> bool {
+                const auto order = StrCompareNatural(arena.Name(c1), arena.Name(c2));
+                return order ? order > 0 : c1.offset < c2.offset;
+            }
+        );
+
+    DWORD result;
+    if (options.threads > 1 && state.fanouts < options.depth)
+        result = Fanout(state, i, frame.first, frame.error);
+    else if ((result = Advance(state, frame.error)) == RESOLVE_PENDING)
+        return result;
+    arena.Pop();
+    return result;
+}
+
+// Lists the directory of the last segment, and takes the first match, or the highest version.
+DWORD Path::Find(const ResolveState& state, size_t i)
+{
+    const auto& options = state.options;
+    const auto& fs = *options.fs;
+    const auto counters = state.counters ? &state.counters[i] : nullptr;
+    auto& arena = *state.arena;
+    String stream;
+    const auto currentPath = ToString(i + 1, &stream);
+
+    // The data stream and a trailing separator are exclusive.
+    if (!stream.empty() && m_endsWithSep)
+        return ERROR_INVALID_NAME;
+
+    // Substitutes the segment with the match, and stops the enumeration.
+    const auto take = [&](StrView name, DWORD attributes) -> DWORD {
+        if (state.IsCancelled())
+            return ERROR_CANCELLED;
+        Splice(i, 0, StrView::npos, name);
+        const auto isDirectory = BITALL(attributes, FILE_ATTRIBUTE_DIRECTORY);
+        // If the path ends with a separator, the last item must be a directory.
+        if (m_endsWithSep && !isDirectory)
+            return ERROR_DIRECTORY;
+        // If the path does not specify a data stream.
+        if (stream.empty())
+            return ERROR_RESOURCE_ENUM_USER_STOP;
+        DWORD error;
+        // Directories cannot have a default data stream.
+        if (isDirectory && (stream == L":" || stream[1] == L':'))
+            error = ERROR_DIRECTORY_NOT_SUPPORTED;
+        else
+        {
+            String streamName = stream;
+            if (streamName.find_first_of(L':', 1) == String::npos)
+                streamName += L":$DATA";
+            // Start enumerating file/directory data streams.
+            if (counters) ++counters->streams;
+            error = fs.EnumerateStreams(ToString(),
+                [&](WIN32_FIND_STREAM_DATA* pfd) -> DWORD {
+                    if (StrEqual(pfd->cStreamName, streamName, true))
                     {
-                        String streamName = stream;
-                        if (streamName.find_first_of(L':', 1) == String::npos)
-                            streamName += L":$DATA";
-                        // Start enumerating file/directory data streams.
-                        error = EnumerateStreams(ToString(),
-                            [&](WIN32_FIND_STREAM_DATA* pfd) -> DWORD {
-                                if (StrEqual(pfd->cStreamName, streamName, true))
-                                {
-                                    // Only add the data stream if it is not the default.
-                                    if (pfd->cStreamName[1] != L':')
-                                    {
-                                        // Add the data stream without the ":$DATA" suffix.
-                                        *std::wcsrchr(pfd->cStreamName, L':') = L'\0';
-                                        m_segments[i] += pfd->cStreamName;
-                                    }
-                                    return ERROR_RESOURCE_ENUM_USER_STOP;
-                                }
-                                return NO_ERROR;
-                            }
-                        );
+                        // Only add the data stream if it is not the default.
+                        if (pfd->cStreamName[1] != L':')
+                        {
+                            // Add the data stream without the ":$DATA" suffix.
+                            *std::wcsrchr(pfd->cStreamName, L':') = L'\0';
+                            Splice(i, StrView::npos, 0, pfd->cStreamName);
+                        }
+                        return ERROR_RESOURCE_ENUM_USER_STOP;
                     }
-                    // If there was an error, keep the data stream unchanged.
-                    if (error != ERROR_RESOURCE_ENUM_USER_STOP)
-                        m_segments[i] += stream;
-                    return error;
-                }
-                // Continue enumeration if the current item is not a directory.
-                if (!isDirectory)
                     return NO_ERROR;
-                // Continue the depth-first search at the next segment.
-                error = Resolve(i + 1);
-                // Continue enumeration if no matching items have been found.
-                if (error == ERROR_FILE_NOT_FOUND || error == ERROR_NO_MORE_FILES)
-                    return NO_ERROR;
-                // Stop enumeration if an error has occurred or an item has been found.
-                return error;
+                }
+            );
+        }
+        // If there was an error, keep the data stream unchanged.
+        if (error != ERROR_RESOURCE_ENUM_USER_STOP)
+            Splice(i, StrView::npos, 0, stream);
+        return error;
+    };
+
+    // Start enumerating files and directories, and take the first one.
+    if (counters) ++counters->enumerations;
+    if (!IsPattern(Segment(i)) || !BITALL(options.flags, PATH_RESOLVE_FLAG_RANK))
+        return fs.EnumerateFiles(currentPath,
+            [&](const FileEntry& entry) -> DWORD {
+                if (counters) ++counters->entries;
+                if (state.budget)
+                    if (const auto error = state.budget->Spend(1, 0))
+                        return error;
+                return take(entry.name, entry.attributes);
             }
         );
-    }
-    return error;
+
+    // Keep the highest version, in the arena; the first one listed, among equal versions.
+    const auto mark = arena.names.size();
+    Optional<DWORD> best;
+    const auto error = fs.EnumerateFiles(currentPath,
+        [&](const FileEntry& entry) -> DWORD {
+            if (counters) ++counters->entries;
+            if (state.budget)
+                if (const auto error = state.budget->Spend(1, 0))
+                    return error;
+            if (!best || StrCompareNatural(entry.name, StrView(arena.names).substr(mark)) > 0)
+            {
+                arena.names.resize(mark);
+                arena.names += entry.name;
+                best = entry.attributes;
+            }
+            return NO_ERROR;
+        }
+    );
+    DWORD result = error;
+    // The listing is incomplete once a limit is reached.
+    if (state.budget && state.budget->error)
+        result = state.budget->error;
+    else if (best)
+        result = take(StrView(arena.names).substr(mark), *best);
+    arena.names.resize(mark);
+    return result;
 }
 
-void Path::MakeAbsolute()
+/**
+ * Searches the subtrees of the candidate directories of the frame on top in parallel.
+ * Threads take the candidates in order; once one has a result, the later ones are cancelled,
+ * so the result is the same as searching them one after the other.
+ */
+DWORD Path::Fanout(const ResolveState& state, size_t i, size_t first, DWORD error)
 {
-    if (m_type == PATH_TYPE_ROOTED)
+    const auto& arena = *state.arena;
+    const auto candidates = std::span(arena.candidates).subspan(first);
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> best = candidates.size();
+    Vector<Optional<Path>> paths(candidates.size());
+    Vector<DWORD> errors(candidates.size(), NO_ERROR);
+
+    const auto work = [&]() {
+        // The candidates are read from the arena of this frame, which is not changed until all threads finish.
+        // Each thread reuses its copy of the path: a subtree without a match leaves only the next segment
+        // changed, which is restored from the pattern; a cancelled one may leave more, so it is copied again.
+        ResolveArena subtree;
+        Optional<Path> path;
+        for (size_t k; (k = next++) < candidates.size(); )
+        {
+            if (best.load() < k || state.IsCancelled() || (state.budget && state.budget->error))
+                continue;
+            if (!path) path.emplace(*this);
+            path->Splice(i, 0, StrView::npos, arena.Name(candidates[k]));
+            if (state.counters) ++state.counters[i].descents;
+            const auto result = path->Resolve({ state.options, state.threads, state.fanouts + 1, &best, k, &state, state.counters, state.literals, state.budget, &subtree }, i + 1);
+            // Continue if no matching items have been found, or the subtree was cancelled.
+            if (result == ERROR_CANCELLED)
+            {
+                path.reset();
+                continue;
+            }
+            if (result == ERROR_FILE_NOT_FOUND || result == ERROR_NO_MORE_FILES)
+            {
+                path->Splice(i + 1, 0, StrView::npos, Segment(i + 1));
+                if (state.counters) ++state.counters[i].backtracks;
+                // A limit reached stops the search, which returns its error unless an earlier candidate has a result.
+                if (state.budget && state.budget->Spend(0, 1))
+                    break;
+                continue;
+            }
+            errors[k] = result;
+            paths[k] = std::move(path);
+            path.reset();
+            // Cancel the later candidates.
+            auto b = best.load();
+            while (k < b && !best.compare_exchange_weak(b, k)) { }
+        }
+    };
+
+    // Take as many spare threads as needed; the current thread also searches.
+    auto spare = state.threads.load();
+    uint32_t count;
+    do count = (uint32_t)std::min<size_t>(spare, candidates.size() - !candidates.empty());
+    while (!state.threads.compare_exchange_weak(spare, spare - count));
+
+    Vector<std::jthread> workers;
+    for (uint32_t n = 0; n < count; ++n)
+        workers.emplace_back(work);
+    work();
+    workers.clear();
+    state.threads += count;
+
+    if (const auto k = best.load(); k < candidates.size())
     {
-        auto path = CURRENT_DIRECTORY_ROOT_PATH;
-        MoveFrom(path, false);
+        *this = std::move(*paths[k]);
+        return errors[k];
     }
-    else if (m_type == PATH_TYPE_RELATIVE)
+    if (state.budget && state.budget->error)
+        return state.budget->error;
+    return state.IsCancelled() ? ERROR_CANCELLED : error;
+}
+
+/**
+ * Looks up a run of literal segments with a single probe of the joined path,
+ * instead of listing the directory of each one, and pushes a frame that continues the search after the run.
+ * The segments keep the case of the pattern, since the names are not read from a listing.
+ */
+DWORD Path::Probe(const ResolveState& state, size_t i, size_t count, std::chrono::steady_clock::time_point start)
+{
+    const auto counters = state.counters ? &state.counters[i] : nullptr;
+    const auto last = i + count - 1;
+
+    if (state.IsCancelled())
+        return ERROR_CANCELLED;
+    if (state.budget)
+        if (const auto error = state.budget->Spend(1, 0))
+            return error;
+    if (counters) ++counters->probes;
+    // Only missing items are skipped; other errors, such as access denied, stop the search.
+    DWORD attributes;
+    if (const auto error = state.options.fs->GetAttributes(ToString(last + 1), attributes))
+        return error == ERROR_PATH_NOT_FOUND ? ERROR_FILE_NOT_FOUND : error;
+    const auto isDirectory = BITALL(attributes, FILE_ATTRIBUTE_DIRECTORY);
+
+    if (last == m_ends.Size() - 1)
     {
-        auto path = CURRENT_DIRECTORY_FULL_PATH;
-        MoveFrom(path, true);
+        // If the path ends with a separator, the last item must be a directory.
+        if (m_endsWithSep && !isDirectory)
+            return ERROR_DIRECTORY;
+        return ERROR_RESOURCE_ENUM_USER_STOP;
     }
+    if (!isDirectory)
+        return ERROR_NO_MORE_FILES;
+
+    // The next segment is overwritten by the subtree search, and must be restored when backtracking.
+    // The frame has no candidates, so its result is that of the subtree.
+    state.arena->Push(i, last + 1, Segment(last + 1), start);
+    if (counters) ++counters->descents;
+    return RESOLVE_PENDING;
+}
+
+void Path::MakeAbsolute()
+{
+    if (m_type == PATH_TYPE_ROOTED)
+        Rebase(CURRENT_DIRECTORY_ROOT_PATH);
+    else if (m_type == PATH_TYPE_RELATIVE)
+        Rebase(CURRENT_DIRECTORY_FULL_PATH);
     else if (m_type == PATH_TYPE_DRIVE_RELATIVE)
     {
         // If the drive letter matches the current directory drive letter, use that directory.
         auto path = CURRENT_DIRECTORY_FULL_PATH;
-        if (path.m_type == PATH_TYPE_DRIVE_ABSOLUTE && path.m_root == m_root)
-            MoveFrom(path, true);
+        if (path.m_type == PATH_TYPE_DRIVE_ABSOLUTE && path.Root() == Root())
+            Rebase(std::move(path));
         else
         {
-            const auto name = std::format(L"={}:", m_root[0]);
+            const auto root = std::format(L"{}\\", Root());
+            const auto name = std::format(L"={}:", root[0]);
             // If the environment variable "=X:" exists, use its value.
             path = CREATE_PATH_ABSOLUTE(GetEnvironmentVariable(name), 0);
             if (path.m_type == PATH_TYPE_DRIVE_ABSOLUTE)
-                MoveFrom(path, true);
+                Rebase(std::move(path));
             // If all else fails, use the drive letter and update the environment variable.
             else
             {
-                m_type = PATH_TYPE_DRIVE_ABSOLUTE;
-                SetEnvironmentVariable(name, m_root + L"\\");
+                SetEnvironmentVariable(name, root);
+                Rebase(CREATE_PATH_ABSOLUTE(root, PATH_FLAG_IGNORE_SEGMENTS));
             }
         }
     }
-
-    // Process ".." in the path segments.
-    size_t size = 0;
-    for (size_t i = 0; i < m_segments.size(); ++i)
+    // Process ".." in the path segments, which may have been appended with `/=`.
+    else if (IsAbsolute())
     {
-        if (m_segments[i] == L"..")
+        for (size_t i = 0; i < m_ends.Size(); ++i)
         {
-            if (size > 0)
-                --size;
+            if (Segment(i) == L"..")
+            {
+                Rebase(Path(ToString(0)));
+                break;
+            }
         }
-        else
-            m_segments[size++] = std::move(m_segments[i]);
     }
-    m_segments.resize(size);
 }
 
 bool Path::IsDevice() const
@@ -340,21 +836,24 @@ bool Path::IsRelative() const
 
 bool Path::operator==(const Path& rhs) const
 {
-    return
-        m_type == rhs.m_type &&
-        m_root == rhs.m_root &&
-        StrEqual(m_server, rhs.m_server, true) &&
-        std::ranges::equal(m_segments, rhs.m_segments,
-            [](const String& s1, const String& s2) -> bool {
-                return StrEqual(s1, s2, true);
-            }
-        );
+    if (m_type != rhs.m_type || Root() != rhs.Root() || !StrEqual(Server(), rhs.Server(), true))
+        return false;
+    if (m_ends.Size() != rhs.m_ends.Size())
+        return false;
+    for (size_t i = 0; i < m_ends.Size(); ++i)
+        if (!StrEqual(Segment(i), rhs.Segment(i), true))
+            return false;
+    return true;
 }
 
 Path& Path::operator/=(const Path& rhs)
 {
+    if (this == &rhs)
+        return *this /= Path(rhs);
     m_endsWithSep = rhs.m_endsWithSep;
-    m_segments.append_range(rhs.m_segments);
+    for (size_t i = 0; i < rhs.m_ends.Size(); ++i)
+        PushSegment(rhs.Segment(i));
+    Seal();
     return *this;
 }
 
@@ -377,7 +876,7 @@ bool Path::IsPattern(StrView path)
 
 wchar_t Path::At(size_t index) const
 {
-    return m_pView->data()[index];
+    return index < m_pView->size() ? m_pView->data()[index] : L'\0';
 }
 
 bool Path::IsSep(size_t index) const
@@ -386,19 +885,129 @@ bool Path::IsSep(size_t index) const
     return c == L'\\' || c == L'/';
 }
 
-void Path::MoveFrom(Path& path, bool moveSegments)
+StrView Path::Root() const
+{
+    return StrView(m_path).substr(m_prefix - m_root, m_root);
+}
+
+StrView Path::Server() const
+{
+    if (!m_server) return L"";
+    return StrView(m_path).substr(m_prefix - m_root - 1 - m_server, m_server);
+}
+
+size_t Path::SegmentStart(size_t i) const
+{
+    if (i) return m_ends[i - 1] + 1;
+    return m_prefix + (m_type != PATH_TYPE_DRIVE_RELATIVE);
+}
+
+// Appends a segment; `Seal` must be called afterwards.
+void Path::PushSegment(StrView segment)
+{
+    m_path.resize(m_ends.Empty() ? m_prefix : m_ends.Back());
+    if (!m_ends.Empty() || m_type != PATH_TYPE_DRIVE_RELATIVE)
+        m_path.push_back(L'\\');
+    m_path.append(segment);
+    m_ends.Push((uint32_t)m_path.size());
+}
+
+// Removes the last segment; `Seal` must be called afterwards.
+void Path::PopSegment()
+{
+    m_ends.Pop();
+}
+
+// Replaces `count` characters at `offset` of the specified segment, in place.
+void Path::Splice(size_t i, size_t offset, size_t count, StrView str)
+{
+    const auto start = SegmentStart(i);
+    offset = std::min(offset, m_ends[i] - start);
+    count = std::min(count, m_ends[i] - start - offset);
+    m_path.replace(start + offset, count, str);
+    for (auto& end : m_ends | std::views::drop(i))
+        end = (uint32_t)(end + str.size() - count);
+}
+
+// Truncates the buffer after the last segment, and adds the trailing separator if needed.
+void Path::Seal()
+{
+    m_path.resize(m_ends.Empty() ? m_prefix : m_ends.Back());
+    if (m_ends.Empty() || m_endsWithSep)
+        m_path.push_back(L'\\');
+}
+
+// Replaces the prefix with the one of an absolute path, and prepends its segments.
+void Path::Rebase(Path path)
 {
     if (!path.IsAbsolute())
         throw std::runtime_error("");
 
-    m_type = path.m_type;
-    m_server = std::move(path.m_server);
-    m_root = std::move(path.m_root);
+    std::swap(*this, path);
+    m_endsWithSep = path.m_endsWithSep;
+
+    for (size_t i = 0; i < path.m_ends.Size(); ++i)
+    {
+        const auto segment = path.Segment(i);
+        if (segment != L"..")
+            PushSegment(segment);
+        else if (!m_ends.Empty())
+            PopSegment();
+    }
+
+    Seal();
+}
 
-    if (moveSegments)
+size_t ResolveHedged(size_t count, DWORD hedge, Function<DWORD(size_t, const std::atomic<bool>&)> resolve, Vector<DWORD>& errors)
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::atomic<bool> cancel = false;
+    errors.assign(count, ERROR_CANCELLED);
+    Vector<std::jthread> threads;
+
+    size_t started = 0, result = count;
+    std::chrono::steady_clock::time_point next; // when the next alternative is started, if the previous ones are still running
+    std::unique_lock lock(mutex);
+    for (;;)
     {
-        for (auto& segment : m_segments)
-            path.m_segments.push_back(std::move(segment));
-        m_segments = std::move(path.m_segments);
+        // An alternative is started only once the earlier ones have failed or missed the delay,
+        // so the earliest one found is the result.
+        const auto results = std::span(errors).first(started);
+        const auto found = (size_t)(std::ranges::find(results, (DWORD)ERROR_RESOURCE_ENUM_USER_STOP) - results.begin());
+        const auto running = std::ranges::count(results, (DWORD)ERROR_IO_PENDING);
+        if (found < started)
+        {
+            result = found;
+            break;
+        }
+        if (!running && started == count)
+            break;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (started < count && (!running || (hedge != INFINITE && now >= next)))
+        {
+            errors[started] = ERROR_IO_PENDING;
+            threads.emplace_back([&, index = started]() {
+                const auto error = resolve(index, cancel);
+                {
+                    std::scoped_lock lock(mutex);
+                    errors[index] = error;
+                }
+                changed.notify_all();
+            });
+            ++started;
+            next = now + std::chrono::milliseconds(hedge == INFINITE ? 0 : hedge);
+        }
+        else if (started < count && hedge != INFINITE)
+            changed.wait_until(lock, next);
+        else
+            changed.wait(lock);
     }
+
+    // Stop the alternatives still running, and wait for them, so nothing they use is released before.
+    cancel = true;
+    lock.unlock();
+    threads.clear();
+    return result;
 }
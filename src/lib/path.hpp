@@ -15,6 +15,43 @@ constexpr uint32_t PATH_FLAG_IGNORE_RELATIVE       = 1 << 1;
 constexpr uint32_t PATH_FLAG_IGNORE_DRIVE_RELATIVE = 1 << 2;
 constexpr uint32_t PATH_FLAG_IGNORE_SEGMENTS       = 1 << 3;
 
+constexpr uint32_t PATH_RESOLVE_FLAG_RANK = 1 << 0; // Search the highest version first at wildcard segments.
+constexpr uint32_t PATH_RESOLVE_FLAG_MEMO = 1 << 1; // Serve repeated file system queries from memory.
+
+// The work done at a segment of the path.
+struct PathResolveSegmentStats
+{
+    size_t enumerations = 0;   // directory listings queried
+    size_t entries = 0;        // entries examined
+    size_t descents = 0;       // directories descended into
+    size_t backtracks = 0;     // directories descended into, without a match below
+    size_t streams = 0;        // data stream listings queried
+    size_t probes = 0;         // runs of literal segments looked up
+    uint64_t microseconds = 0; // time spent searching from the segment, including the segments below (summed over threads)
+};
+
+struct PathResolveStats
+{
+    size_t memoHits = 0;         // queries served from memory
+    size_t memoNegativeHits = 0; // queries served from memory, of items not found
+    size_t memoMisses = 0;       // queries forwarded to the file system
+    uint64_t microseconds = 0;   // total time
+    Vector<PathResolveSegmentStats> segments; // by segment index, of the absolute path
+};
+
+struct PathResolveOptions
+{
+    const FileSystem* fs = &FileSystem::Native();
+    uint32_t flags = 0;   // PATH_RESOLVE_FLAG_*
+    uint32_t threads = 1; // maximum number of threads searching in parallel
+    uint32_t depth = 1;   // maximum number of nested wildcard segments searched in parallel
+    uint32_t deadline = 0;      // maximum time, in milliseconds, then `ERROR_TIMEOUT` (0 = no limit)
+    size_t maxEntries = 0;      // maximum entries examined, then `ERROR_NOT_ENOUGH_QUOTA` (0 = no limit)
+    size_t maxBacktracks = 0;   // maximum directories without a match below, then `ERROR_NOT_ENOUGH_QUOTA` (0 = no limit)
+    const std::atomic<bool>* cancel = nullptr; // once set, the search stops with `ERROR_CANCELLED`
+    PathResolveStats* stats = nullptr;
+};
+
 /**
  * A simple class for long paths in Windows.
  * Reference:
@@ -29,8 +66,10 @@ public:
 
     uint8_t Type() const;
     StrView Name() const;
+    StrView Segment(size_t i) const;
+    size_t SegmentCount() const;
     StrView ToString(int64_t nseg = INT64_MAX, String* stream = nullptr) const;
-    DWORD Resolve(size_t i = 0);
+    DWORD Resolve(const PathResolveOptions& options = { });
     void MakeAbsolute();
 
     bool IsDevice() const;
@@ -45,16 +84,51 @@ public:
 
     static bool IsPattern(StrView path);
 private:
+    struct ResolveState;
+    struct ResolveCounters;
+    struct ResolveBudget;
+    struct ResolveArena;
+
+    DWORD Resolve(const ResolveState&, size_t);
+    DWORD Open(const ResolveState&, size_t);
+    DWORD Next(const ResolveState&, DWORD);
+    DWORD Advance(const ResolveState&, DWORD);
+    DWORD List(const ResolveState&, size_t, std::chrono::steady_clock::time_point);
+    DWORD Find(const ResolveState&, size_t);
+    DWORD Fanout(const ResolveState&, size_t, size_t, DWORD);
+    DWORD Probe(const ResolveState&, size_t, size_t, std::chrono::steady_clock::time_point);
     wchar_t At(size_t) const;
     bool IsSep(size_t) const;
-    void MoveFrom(Path&, bool);
+    StrView Root() const;
+    StrView Server() const;
+    size_t SegmentStart(size_t) const;
+    void PushSegment(StrView);
+    void PopSegment();
+    void Splice(size_t, size_t, size_t, StrView);
+    void Seal();
+    void Rebase(Path);
 
     StrView* m_pView;
-    mutable String m_path;
+
+    // The path is stored in a single buffer, in the form returned by `ToString()`:
+    // <prefix> [\]<segment> \<segment> ... [\]
+    String m_path;
+    SmallVector<uint32_t, 16> m_ends; // end offset of each segment in the buffer
 
     bool m_endsWithSep = false; // Whether the path ends with a separator.
     uint8_t m_type = 0;         // path type
-    String m_server;            // UNC server (domain name or IP address)
-    String m_root;              // UNC share name | drive letter
-    Vector<String> m_segments;  // components / elements / directories / filename
+    uint32_t m_prefix = 0;      // prefix length ("\\?\X:", "\\?\UNC\server\share", ...)
+    uint32_t m_root = 0;        // UNC share name | drive letter length, at the end of the prefix
+    uint32_t m_server = 0;      // UNC server (domain name or IP address) length, before the root
 };
+
+/**
+ * Resolves the ordered alternatives of a path, each on its own thread, preferring the earlier ones.
+ * An alternative is started once the previous one has failed, or has not finished within `hedge`
+ * milliseconds (`INFINITE` = only once it has failed). The first alternative found is the result,
+ * and the others are cancelled, then waited for: a query that blocks on a slow share delays the
+ * result until it returns. `resolve` is called with the alternative index and the cancellation flag.
+ * `errors` receives the result of each alternative, or `ERROR_CANCELLED` if it was not started.
+ * Returns the index of the alternative found, or `count`.
+ */
+size_t ResolveHedged(size_t count, DWORD hedge, Function<DWORD(size_t, const std::atomic<bool>&)> resolve, Vector<DWORD>& errors);
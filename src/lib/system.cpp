@@ -0,0 +1,213 @@
+#include "../framework.hpp"
+
+String SystemErrorToString(DWORD error)
+{
+    PWSTR buffer = nullptr;
+    auto size = FormatMessageW(
+        FORMAT_MESSAGE_FROM_SYSTEM |
+        FORMAT_MESSAGE_IGNORE_INSERTS |
+        FORMAT_MESSAGE_ALLOCATE_BUFFER,
+        nullptr, error, 0, (PWSTR)&buffer, 0, nullptr);
+    while (size && iswspace(buffer[size - 1])) --size;
+    String message(buffer, size);
+    LocalFree(buffer);
+    return message;
+}
+
+// Decodes UTF-16 LE text with a BOM, or UTF-8 text with or without a BOM.
+String DecodeText(std::string_view bytes)
+{
+    String text;
+    if (bytes.starts_with("\xFF\xFE"))
+    {
+        bytes.remove_prefix(2);
+        text.resize(bytes.size() / sizeof(wchar_t));
+        bytes.copy(reinterpret_cast<char*>(text.data()), text.size() * sizeof(wchar_t));
+        return text;
+    }
+    if (bytes.starts_with("\xEF\xBB\xBF"))
+        bytes.remove_prefix(3);
+    if (bytes.empty() || bytes.size() > INT_MAX)
+        return text;
+    text.resize_and_overwrite(bytes.size(),
+        [&](wchar_t* ptr, size_t count) -> size_t {
+            return MultiByteToWideChar(CP_UTF8, 0, bytes.data(), (INT)bytes.size(), ptr, (INT)count);
+        }
+    );
+    return text;
+}
+
+// Reads from the current position to the end of a file or pipe.
+Optional<std::string> ReadAll(HANDLE hFile)
+{
+    std::string bytes;
+    char buffer[0x10000];
+    for (DWORD bytesRead; ; bytes.append(buffer, bytesRead))
+    {
+        if (!ReadFile(hFile, buffer, sizeof(buffer), &bytesRead, nullptr))
+            return GetLastError() == ERROR_BROKEN_PIPE ? Optional(bytes) : std::nullopt;
+        if (!bytesRead) return bytes;
+    }
+}
+
+String GetModulePath(HMODULE hModule)
+{
+    String str;
+    str.resize_and_overwrite(PATH_MAX - 1,
+        [&](wchar_t* ptr, size_t count) -> size_t {
+            return GetModuleFileNameW(hModule, ptr, (DWORD)count);
+        }
+    );
+    str.shrink_to_fit();
+    return str;
+}
+
+/**
+ * Releases the free heap memory to the system, and removes all pages from the working set.
+ * Pages accessed again are read back from the image or the page file; used before idle waits.
+ */
+void TrimMemory()
+{
+    HeapCompact(GetProcessHeap(), 0);
+    SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
+}
+
+// Returns the `TOKEN_USER` of the process, which holds the SID of its user.
+static Optional<Vector<BYTE>> GetProcessUser(HANDLE hProcess)
+{
+    HANDLE hToken;
+    if (!OpenProcessToken(hProcess, TOKEN_QUERY, &hToken))
+        return std::nullopt;
+    DWORD size = 0;
+    GetTokenInformation(hToken, TokenUser, nullptr, 0, &size);
+    Vector<BYTE> user(size);
+    const auto result = size && GetTokenInformation(hToken, TokenUser, user.data(), size, &size);
+    CloseHandle(hToken);
+    if (!result) return std::nullopt;
+    return user;
+}
+
+/**
+ * Returns the name of a local pipe for the current session and user.
+ * Pipe names are global, so the name only avoids the servers of other users; `ConnectPipe` verifies them.
+ */
+String GetSessionPipeName(StrView name)
+{
+    DWORD sessionId = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &sessionId);
+    String sid;
+    PWSTR str;
+    const auto user = GetProcessUser(GetCurrentProcess());
+    if (user && ConvertSidToStringSidW(((TOKEN_USER*)user->data())->User.Sid, &str))
+    {
+        sid = str;
+        LocalFree(str);
+    }
+    return std::format(L"\\\\.\\pipe\\exelnk.{}.{}.{}", name, sessionId, sid);
+}
+
+/**
+ * Connects to a local pipe in message mode, waiting once if the server is busy.
+ * The server must run as the same user, since any process can create a pipe with a known name;
+ * and it can only identify the client, not impersonate it.
+ * Returns `INVALID_HANDLE_VALUE` on error, with the last error set (`ERROR_ACCESS_DENIED` for another user).
+ */
+HANDLE ConnectPipe(StrView name)
+{
+    const String path(name);
+    HANDLE hPipe = INVALID_HANDLE_VALUE;
+    for (auto retry = true; hPipe == INVALID_HANDLE_VALUE; retry = false)
+    {
+        hPipe = CreateFileW(path.data(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING,
+            SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION, nullptr);
+        if (hPipe == INVALID_HANDLE_VALUE && !(retry && GetLastError() == ERROR_PIPE_BUSY && WaitNamedPipeW(path.data(), 1000)))
+            return INVALID_HANDLE_VALUE;
+    }
+
+    ULONG processId;
+    bool trusted = false;
+    if (GetNamedPipeServerProcessId(hPipe, &processId))
+    {
+        if (const auto hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId))
+        {
+            const auto server = GetProcessUser(hProcess);
+            const auto client = GetProcessUser(GetCurrentProcess());
+            trusted = server && client && EqualSid(((TOKEN_USER*)server->data())->User.Sid, ((TOKEN_USER*)client->data())->User.Sid);
+            CloseHandle(hProcess);
+        }
+    }
+    DWORD mode = PIPE_READMODE_MESSAGE;
+    if (!trusted || !SetNamedPipeHandleState(hPipe, &mode, nullptr, nullptr))
+    {
+        const auto error = trusted ? GetLastError() : ERROR_ACCESS_DENIED;
+        CloseHandle(hPipe);
+        SetLastError(error);
+        return INVALID_HANDLE_VALUE;
+    }
+    return hPipe;
+}
+
+// Reads a whole message from a pipe in message mode.
+DWORD ReadMessage(HANDLE hPipe, String& message)
+{
+    wchar_t buffer[0x800];
+    message.clear();
+    for (DWORD bytesRead; ; )
+    {
+        const auto result = ReadFile(hPipe, buffer, sizeof(buffer), &bytesRead, nullptr);
+        message.append(buffer, bytesRead / sizeof(wchar_t));
+        if (result) return NO_ERROR;
+        if (GetLastError() != ERROR_MORE_DATA)
+            return GetLastError();
+    }
+}
+
+// Lists the directory in large batches, without the short names.
+// The callback receives a view of each entry, in the buffer reused for the whole listing.
+DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn)
+{
+    WIN32_FIND_DATA data;
+    auto hFindFile = FindFirstFileExW(String(path).data(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (hFindFile == INVALID_HANDLE_VALUE)
+        return GetLastError();
+    DWORD error = NO_ERROR;
+    for (;;)
+    {
+        const StrView name(data.cFileName);
+        if (name != L"." && name != L"..")
+        {
+            error = fn({ name, data.dwFileAttributes });
+            if (error != NO_ERROR)
+                break;
+        }
+        if (!FindNextFileW(hFindFile, &data))
+        {
+            error = GetLastError();
+            break;
+        }
+    }
+    FindClose(hFindFile);
+    return error;
+}
+
+DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn)
+{
+    WIN32_FIND_STREAM_DATA data;
+    auto hFindStream = FindFirstStreamW(String(path).data(), FindStreamInfoStandard, &data, 0);
+    if (hFindStream == INVALID_HANDLE_VALUE)
+        return GetLastError();
+    DWORD error = NO_ERROR;
+    for (;;)
+    {
+        error = fn(&data);
+        if (error != NO_ERROR)
+            break;
+        if (!FindNextStreamW(hFindStream, &data))
+        {
+            error = GetLastError();
+            break;
+        }
+    }
+    FindClose(hFindStream);
+    return error;
+}
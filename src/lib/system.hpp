@@ -0,0 +1,12 @@
+#pragma once
+
+String SystemErrorToString(DWORD error);
+String DecodeText(std::string_view bytes);
+Optional<std::string> ReadAll(HANDLE hFile);
+String GetModulePath(HMODULE hModule);
+void TrimMemory();
+String GetSessionPipeName(StrView name);
+HANDLE ConnectPipe(StrView name);
+DWORD ReadMessage(HANDLE hPipe, String& message);
+DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn);
+DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn);
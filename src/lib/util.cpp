@@ -1,4 +1,4 @@
-#include "../framework.hpp"
+#include "../portable.hpp"
 
 size_t ClampIndex(int64_t i, size_t size)
 {
@@ -14,39 +14,236 @@ Optional<int64_t> StrToInt(StrView str, INT base)
     return i;
 }
 
+// The upper case table of the system, which the file system uses to compare names.
+static const wchar_t* UpcaseTable()
+{
+    static const auto table = [] {
+        auto table = std::make_unique<wchar_t[]>(0x10000);
+        for (size_t c = 0; c < 0x10000; ++c)
+            table[c] = (wchar_t)c;
+        // Surrogates are left unmapped; each range around them is mapped in a single call.
+        Vector<wchar_t> buffer;
+        for (const auto& [first, last] : { std::pair(0x80, 0xD800), std::pair(0xE000, 0x10000) })
+        {
+            const auto n = last - first;
+            buffer.resize(n);
+            if (LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_UPPERCASE, table.get() + first, n,
+                buffer.data(), n, nullptr, nullptr, 0) == n)
+                std::ranges::copy(buffer, table.get() + first);
+            else
+                std::transform(table.get() + first, table.get() + last, table.get() + first, towupper);
+        }
+        for (wchar_t c = L'a'; c <= L'z'; ++c)
+            table[c] = c - 0x20;
+        return table;
+    }();
+    return table.get();
+}
+
+#if (defined(_M_X64) || defined(__SSE2__)) && WCHAR_MAX == 0xFFFF
+#define STR_SSE2
+#include <emmintrin.h>
+
+// Whether all 8 characters are ASCII.
+static bool IsAscii(__m128i v)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xFF80)), _mm_setzero_si128())) == 0xFFFF;
+}
+
+// Converts 8 ASCII characters to upper case.
+static __m128i FoldAscii(__m128i v)
+{
+    const auto lower = _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16(L'a' - 1)), _mm_cmplt_epi16(v, _mm_set1_epi16(L'z' + 1)));
+    return _mm_sub_epi16(v, _mm_and_si128(lower, _mm_set1_epi16(0x20)));
+}
+#endif
+
+// Returns the index of the first character that differs case-insensitively, or `n`.
+// Blocks of ASCII characters are compared 8 at a time; the rest, through the upper case table.
+static size_t FoldMismatch(const wchar_t* s1, const wchar_t* s2, size_t n)
+{
+    size_t i = 0;
+#ifdef STR_SSE2
+    for (; i + 8 <= n; i += 8)
+    {
+        const auto v1 = _mm_loadu_si128((const __m128i*)(s1 + i));
+        const auto v2 = _mm_loadu_si128((const __m128i*)(s2 + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(v1, v2)) == 0xFFFF)
+            continue;
+        if (!IsAscii(_mm_or_si128(v1, v2)))
+        {
+            for (const auto end = i + 8; i < end; ++i)
+                if (CharFoldCase(s1[i]) != CharFoldCase(s2[i]))
+                    return i;
+            i -= 8;
+            continue;
+        }
+        if (const auto mask = _mm_movemask_epi8(_mm_cmpeq_epi16(FoldAscii(v1), FoldAscii(v2))); mask != 0xFFFF)
+            return i + std::countr_zero((uint32_t)~mask & 0xFFFF) / 2;
+    }
+#endif
+    for (; i < n; ++i)
+        if (CharFoldCase(s1[i]) != CharFoldCase(s2[i]))
+            return i;
+    return n;
+}
+
+// Returns the character in upper case, like the file system compares names (NTFS, `CompareStringOrdinal`).
+wchar_t CharFoldCase(wchar_t c)
+{
+    if (c < 0x80)
+        return c >= L'a' && c <= L'z' ? c - 0x20 : c;
+    return (uint32_t)c < 0x10000 ? UpcaseTable()[c] : c;
+}
+
 bool StrEqual(StrView s1, StrView s2, bool icase)
 {
     if (!icase) return s1 == s2;
-    return std::ranges::equal(s1, s2,
-        [](wchar_t c1, wchar_t c2) -> bool {
-            return towupper(c1) == towupper(c2);
-        }
-    );
+    return s1.size() == s2.size() && FoldMismatch(s1.data(), s2.data(), s1.size()) == s1.size();
 }
 
-String SystemErrorToString(DWORD error)
+// Compares by the ordinal value of the characters, in upper case if `icase` is set.
+int StrCompare(StrView s1, StrView s2, bool icase)
 {
-    PWSTR buffer = nullptr;
-    auto size = FormatMessageW(
-        FORMAT_MESSAGE_FROM_SYSTEM |
-        FORMAT_MESSAGE_IGNORE_INSERTS |
-        FORMAT_MESSAGE_ALLOCATE_BUFFER,
-        nullptr, error, 0, (PWSTR)&buffer, 0, nullptr);
-    while (size && iswspace(buffer[size - 1])) --size;
-    String message(buffer, size);
-    LocalFree(buffer);
-    return message;
+    if (!icase) return s1.compare(s2);
+    const auto n = std::min(s1.size(), s2.size());
+    if (const auto i = FoldMismatch(s1.data(), s2.data(), n); i < n)
+        return CharFoldCase(s1[i]) < CharFoldCase(s2[i]) ? -1 : 1;
+    return (s1.size() > n) - (s2.size() > n);
 }
 
-String GetModulePath(HMODULE hModule)
+// Returns the string in upper case, to be compared or hashed case-insensitively like the file system.
+String StrFoldCase(StrView str)
 {
-    String str;
-    str.resize_and_overwrite(PATH_MAX - 1,
-        [&](wchar_t* ptr, size_t count) -> size_t {
-            return GetModuleFileNameW(hModule, ptr, (DWORD)count);
+    String result(str);
+    size_t i = 0;
+#ifdef STR_SSE2
+    for (; i + 8 <= result.size(); i += 8)
+    {
+        const auto p = (__m128i*)(result.data() + i);
+        if (const auto v = _mm_loadu_si128(p); IsAscii(v))
+            _mm_storeu_si128(p, FoldAscii(v));
+        else
+            std::transform(result.data() + i, result.data() + i + 8, result.data() + i, CharFoldCase);
+    }
+#endif
+    std::transform(result.data() + i, result.data() + result.size(), result.data() + i, CharFoldCase);
+    return result;
+}
+
+// Returns the FNV-1a hash of the string, in upper case if `icase` is set.
+size_t StrHash(StrView str, bool icase)
+{
+    uint64_t hash = 0xCBF29CE484222325;
+    for (const auto c : str)
+        hash = (hash ^ (uint16_t)(icase ? CharFoldCase(c) : c)) * 0x100000001B3;
+    return (size_t)hash;
+}
+
+StrView StrInterner::Intern(StrView str)
+{
+    if (const auto it = m_index.find(str); it != m_index.end())
+        return *it;
+    return *m_index.emplace(m_strings.emplace_back(str)).first;
+}
+
+Optional<StrView> StrInterner::Find(StrView str) const
+{
+    if (const auto it = m_index.find(str); it != m_index.end())
+        return *it;
+    return std::nullopt;
+}
+
+size_t StrInterner::Size() const
+{
+    return m_index.size();
+}
+
+// Compares case-insensitively, with runs of digits compared by their numeric value ("3.9" < "3.10").
+int StrCompareNatural(StrView s1, StrView s2)
+{
+    const auto isDigit = [](wchar_t c) -> bool {
+        return c >= L'0' && c <= L'9';
+    };
+    size_t i = 0, j = 0;
+    while (i < s1.size() && j < s2.size())
+    {
+        if (isDigit(s1[i]) && isDigit(s2[j]))
+        {
+            // Skip leading zeros, then the longer number is the greater one.
+            while (i < s1.size() && s1[i] == L'0') ++i;
+            while (j < s2.size() && s2[j] == L'0') ++j;
+            const auto n1 = std::ranges::find_if_not(s1.substr(i), isDigit) - s1.substr(i).begin();
+            const auto n2 = std::ranges::find_if_not(s2.substr(j), isDigit) - s2.substr(j).begin();
+            if (n1 != n2)
+                return n1 < n2 ? -1 : 1;
+            if (const auto r = s1.substr(i, n1).compare(s2.substr(j, n2)))
+                return r;
+            i += n1;
+            j += n2;
         }
-    );
-    return str;
+        else
+        {
+            const auto c1 = CharFoldCase(s1[i++]);
+            const auto c2 = CharFoldCase(s2[j++]);
+            if (c1 != c2)
+                return c1 < c2 ? -1 : 1;
+        }
+    }
+    return (i < s1.size()) - (j < s2.size());
+}
+
+// Matches `*` (zero or more characters) and `?` (a single character).
+bool WildcardMatch(StrView pattern, StrView str, bool icase)
+{
+    const auto equal = [&](wchar_t c1, wchar_t c2) -> bool {
+        return c1 == c2 || (icase && CharFoldCase(c1) == CharFoldCase(c2));
+    };
+    size_t p = 0, s = 0;
+    size_t star = pattern.npos, mark = 0;
+    while (s < str.size())
+    {
+        if (p < pattern.size() && (pattern[p] == L'?' || (pattern[p] != L'*' && equal(pattern[p], str[s]))))
+        {
+            ++p;
+            ++s;
+        }
+        else if (p < pattern.size() && pattern[p] == L'*')
+        {
+            star = p++;
+            mark = s;
+        }
+        // Backtrack to the last `*` and let it match one more character.
+        else if (star != pattern.npos)
+        {
+            p = star + 1;
+            s = ++mark;
+        }
+        else
+            return false;
+    }
+    while (p < pattern.size() && pattern[p] == L'*')
+        ++p;
+    return p == pattern.size();
+}
+
+// Returns the string as a JSON string literal, in quotes.
+String JsonQuote(StrView str)
+{
+    String result;
+    result.reserve(str.size() + 2);
+    result += L'"';
+    for (const auto c : str)
+    {
+        if (c == L'"' || c == L'\\')
+            (result += L'\\') += c;
+        else if (c < 0x20)
+            result += std::format(L"\\u{:04x}", (uint32_t)c);
+        else
+            result += c;
+    }
+    result += L'"';
+    return result;
 }
 
 String GetCurrentDirectory()
@@ -57,6 +254,7 @@ String GetCurrentDirectory()
             return GetCurrentDirectoryW((DWORD)count, ptr);
         }
     );
+    path.shrink_to_fit();
     return path;
 }
 
@@ -77,89 +275,190 @@ BOOL SetEnvironmentVariable(StrView name, Optional<StrView> value)
     return SetEnvironmentVariableW(name.data(), value ? value->data() : nullptr);
 }
 
+// Returns the length of the argument as written by `AppendArgument`, without the delimiter.
+size_t ArgumentLength(StrView arg, BOOL raw)
+{
+    if (raw) return arg.size();
+    if (arg.empty()) return 2;
+    if (arg.find_first_of(L" \t\"") == arg.npos)
+        return arg.size();
+    // Quoted: the backslashes before a quote or the closing quote are doubled, and quotes are escaped.
+    const auto trailing = arg.size() - (arg.find_last_not_of(L'\\') + 1);
+    auto length = arg.size() + 2 + trailing;
+    for (auto pos = arg.find(L'"'); pos != arg.npos; pos = arg.find(L'"', pos + 1))
+    {
+        const auto start = pos ? arg.find_last_not_of(L'\\', pos - 1) : arg.npos;
+        length += pos - (start == arg.npos ? 0 : start + 1) + 1;
+    }
+    return length;
+}
+
 // https://learn.microsoft.com/archive/blogs/twistylittlepassagesallalike/everyone-quotes-command-line-arguments-the-wrong-way
 String& AppendArgument(String& str, StrView arg, BOOL raw)
 {
     if (raw && arg.empty())
         return str;
 
-    if (!str.empty() && !str.ends_with(L' ') && !str.ends_with(L'\t'))
-        str.push_back(L' '); // delimiter (space or tab)
+    // delimiter (space or tab)
+    const auto delimiter = !str.empty() && !str.ends_with(L' ') && !str.ends_with(L'\t');
+    const auto length = ArgumentLength(arg, raw);
+    const auto offset = str.size();
 
-    if (!raw && arg.empty())
-        return str.append(L"\"\"");
-
-    if (raw || arg.find_first_of(L" \t\"") == arg.npos)
-        return str.append(arg);
-
-    str.push_back(L'"');
-    for (auto it = arg.begin(); ; ++it)
-    {
-        size_t backslashes = 0;
-        while (it != arg.end() && *it == L'\\')
-        {
-            ++it;
-            ++backslashes;
-        }
-        if (it == arg.end())
-        {
-            str.append(backslashes * 2, L'\\');
-            break;
+    // The argument is written in place, and copied in runs between backslashes and quotes.
+    str.resize_and_overwrite(offset + delimiter + length,
+        [&](wchar_t* ptr, size_t) -> size_t {
+            auto out = ptr + offset;
+            if (delimiter) *out++ = L' ';
+            if (length == arg.size())
+            {
+                return (size_t)(std::ranges::copy(arg, out).out - ptr);
+            }
+            *out++ = L'"';
+            for (size_t pos = 0; ; )
+            {
+                const auto next = arg.find_first_of(L"\\\"", pos);
+                out = std::ranges::copy(arg.substr(pos, next == arg.npos ? arg.npos : next - pos), out).out;
+                if (next == arg.npos)
+                    break;
+                const auto end = std::min(arg.find_first_not_of(L'\\', next), arg.size());
+                auto backslashes = end - next;
+                if (end == arg.size() || arg[end] == L'"')
+                    backslashes = backslashes * 2 + (end != arg.size());
+                out = std::fill_n(out, backslashes, L'\\');
+                if (end == arg.size())
+                    break;
+                if (arg[end] == L'"')
+                {
+                    *out++ = L'"';
+                    pos = end + 1;
+                }
+                else pos = end;
+            }
+            *out++ = L'"';
+            return (size_t)(out - ptr);
         }
-        if (*it == L'"')
-            backslashes = backslashes * 2 + 1;
-        str.append(backslashes, L'\\');
-        str.push_back(*it);
-    }
-    str.push_back(L'"');
+    );
 
     return str;
 }
 
-DWORD EnumerateFiles(StrView path, const Function<DWORD(WIN32_FIND_DATA*)>& fn)
+/**
+ * Splits a command line with the rules of the MSVC CRT:
+ * - The program name ends at the next quote if quoted, or at the next whitespace; backslashes are literal.
+ * - `2n` backslashes followed by a quote produce `n` backslashes, and the quote begins or ends a quoted part.
+ * - `2n+1` backslashes followed by a quote produce `n` backslashes and a literal quote.
+ * - Backslashes not followed by a quote are literal.
+ * - Two quotes inside a quoted part produce a literal quote.
+ */
+Vector<String> ParseCommandLine(StrView cmdl)
 {
-    WIN32_FIND_DATA data;
-    auto hFindFile = FindFirstFileExW(path.data(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, 0);
-    if (hFindFile == INVALID_HANDLE_VALUE)
-        return GetLastError();
-    DWORD error = NO_ERROR;
+    Vector<String> args;
+    size_t i = 0;
+
+    if (!cmdl.empty())
+    {
+        const auto quoted = cmdl[0] == L'"';
+        const auto end = std::min(quoted ? cmdl.find(L'"', 1) : cmdl.find_first_of(L" \t"), cmdl.size());
+        args.emplace_back(cmdl.substr(quoted, end - quoted));
+        i = end + (quoted && end != cmdl.size());
+    }
+
     for (;;)
     {
-        StrView name(data.cFileName);
-        if (name != L"." && name != L"..")
+        while (i < cmdl.size() && (cmdl[i] == L' ' || cmdl[i] == L'\t'))
+            ++i;
+        if (i == cmdl.size())
+            break;
+        String arg;
+        for (auto quoted = false; i < cmdl.size(); )
         {
-            error = fn(&data);
-            if (error != NO_ERROR)
+            const auto c = cmdl[i];
+            if (c == L'\\')
+            {
+                const auto end = std::min(cmdl.find_first_not_of(L'\\', i), cmdl.size());
+                const auto backslashes = end - i;
+                i = end;
+                if (i == cmdl.size() || cmdl[i] != L'"')
+                {
+                    arg.append(backslashes, L'\\');
+                    continue;
+                }
+                arg.append(backslashes / 2, L'\\');
+                if (backslashes % 2)
+                {
+                    arg.push_back(L'"');
+                    ++i;
+                }
+                continue;
+            }
+            if (c == L'"')
+            {
+                if (quoted && i + 1 < cmdl.size() && cmdl[i + 1] == L'"')
+                {
+                    arg.push_back(L'"');
+                    i += 2;
+                }
+                else
+                {
+                    quoted = !quoted;
+                    ++i;
+                }
+                continue;
+            }
+            if (!quoted && (c == L' ' || c == L'\t'))
                 break;
+            arg.push_back(c);
+            ++i;
         }
-        if (!FindNextFileW(hFindFile, &data))
-        {
-            error = GetLastError();
-            break;
-        }
+        args.push_back(std::move(arg));
     }
-    FindClose(hFindFile);
-    return error;
+
+    return args;
 }
 
-DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn)
+#ifndef _WIN32
+static_assert(sizeof(wchar_t) == 4, "wchar_t holds a code point outside Windows");
+
+// Encodes the string in UTF-8.
+std::string StrToUtf8(StrView str)
 {
-    WIN32_FIND_STREAM_DATA data;
-    auto hFindStream = FindFirstStreamW(path.data(), FindStreamInfoStandard, &data, 0);
-    if (hFindStream == INVALID_HANDLE_VALUE)
-        return GetLastError();
-    DWORD error = NO_ERROR;
-    for (;;)
+    std::string bytes;
+    bytes.reserve(str.size());
+    for (const auto c : str)
     {
-        error = fn(&data);
-        if (error != NO_ERROR)
-            break;
-        if (!FindNextStreamW(hFindStream, &data))
+        const auto cp = (uint32_t)c;
+        if (cp < 0x80)
+            bytes.push_back((char)cp);
+        else if (cp < 0x800)
+            bytes.append({ (char)(0xC0 | cp >> 6), (char)(0x80 | (cp & 0x3F)) });
+        else if (cp < 0x10000)
+            bytes.append({ (char)(0xE0 | cp >> 12), (char)(0x80 | (cp >> 6 & 0x3F)), (char)(0x80 | (cp & 0x3F)) });
+        else
+            bytes.append({ (char)(0xF0 | cp >> 18), (char)(0x80 | (cp >> 12 & 0x3F)), (char)(0x80 | (cp >> 6 & 0x3F)), (char)(0x80 | (cp & 0x3F)) });
+    }
+    return bytes;
+}
+
+// Decodes UTF-8 into the string; invalid sequences are replaced by U+FFFD.
+void StrFromUtf8(std::string_view bytes, String& str)
+{
+    str.clear();
+    for (size_t i = 0; i < bytes.size(); )
+    {
+        const auto b = (uint8_t)bytes[i];
+        const size_t count = b < 0x80 ? 0 : b >> 5 == 0x06 ? 1 : b >> 4 == 0x0E ? 2 : b >> 3 == 0x1E ? 3 : SIZE_MAX;
+        uint32_t cp = count == 0 ? b : count == 1 ? b & 0x1F : count == 2 ? b & 0x0F : b & 0x07;
+        size_t n = 0;
+        while (count != SIZE_MAX && n < count && i + 1 + n < bytes.size() && ((uint8_t)bytes[i + 1 + n] & 0xC0) == 0x80)
+            cp = cp << 6 | ((uint8_t)bytes[i + 1 + n++] & 0x3F);
+        if (count == SIZE_MAX || n < count)
         {
-            error = GetLastError();
-            break;
+            str.push_back(L'\xFFFD');
+            i += 1 + n;
+            continue;
         }
+        str.push_back((wchar_t)cp);
+        i += 1 + count;
     }
-    FindClose(hFindStream);
-    return error;
 }
+#endif
@@ -5,14 +5,117 @@
 #define PRINT(fmt, ...) \
 	std::wcout << std::format(fmt, __VA_ARGS__) << std::endl
 
+/**
+ * An entry of a directory listing.
+ * The name is a view into the buffer of the listing, valid only during the callback.
+ */
+struct FileEntry
+{
+    StrView name;
+    DWORD attributes;
+};
+
+/**
+ * A vector that stores up to `N` elements inline, and moves them to the heap when it grows beyond.
+ */
+template <typename T, size_t N>
+class SmallVector final
+{
+public:
+    size_t Size() const { return m_size; }
+    bool Empty() const { return !m_size; }
+
+    T& Back() { return Data()[m_size - 1]; }
+    const T& Back() const { return Data()[m_size - 1]; }
+
+    void Push(const T& value)
+    {
+        if (m_heap.empty() && m_size < N)
+            m_inline[m_size] = value;
+        else
+        {
+            if (m_heap.empty())
+                m_heap.assign(m_inline.begin(), m_inline.begin() + m_size);
+            m_heap.push_back(value);
+        }
+        ++m_size;
+    }
+
+    void Pop()
+    {
+        if (!m_heap.empty())
+            m_heap.pop_back();
+        --m_size;
+    }
+
+    void Clear()
+    {
+        m_heap.clear();
+        m_size = 0;
+    }
+
+    T* begin() { return Data(); }
+    T* end() { return Data() + m_size; }
+    const T* begin() const { return Data(); }
+    const T* end() const { return Data() + m_size; }
+
+    T& operator[](size_t i) { return Data()[i]; }
+    const T& operator[](size_t i) const { return Data()[i]; }
+private:
+    T* Data() { return m_heap.empty() ? m_inline.data() : m_heap.data(); }
+    const T* Data() const { return m_heap.empty() ? m_inline.data() : m_heap.data(); }
+
+    size_t m_size = 0;
+    std::array<T, N> m_inline { };
+    Vector<T> m_heap; // all elements, once grown beyond `N`
+};
+
 size_t ClampIndex(int64_t i, size_t size);
 Optional<int64_t> StrToInt(StrView str, INT base = 10);
+wchar_t CharFoldCase(wchar_t c);
 bool StrEqual(StrView s1, StrView s2, bool icase = false);
-String SystemErrorToString(DWORD error);
-String GetModulePath(HMODULE hModule);
+int StrCompare(StrView s1, StrView s2, bool icase = false);
+String StrFoldCase(StrView str);
+size_t StrHash(StrView str, bool icase = false);
+int StrCompareNatural(StrView s1, StrView s2);
+#ifndef _WIN32
+// Outside Windows, names are exchanged with the system in UTF-8.
+std::string StrToUtf8(StrView str);
+void StrFromUtf8(std::string_view bytes, String& str);
+#endif
+bool WildcardMatch(StrView pattern, StrView str, bool icase = false);
+String JsonQuote(StrView str);
 String GetCurrentDirectory();
 String GetEnvironmentVariable(StrView name);
 BOOL SetEnvironmentVariable(StrView name, Optional<StrView> value);
+size_t ArgumentLength(StrView arg, BOOL raw = FALSE);
 String& AppendArgument(String& str, StrView arg, BOOL raw = FALSE);
-DWORD EnumerateFiles(StrView path, const Function<DWORD(WIN32_FIND_DATA*)>& fn);
-DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn);
+Vector<String> ParseCommandLine(StrView cmdl);
+
+// Hash and equality of strings compared case-insensitively, for unordered containers keyed by path.
+struct StrFoldHash
+{
+    using is_transparent = void;
+    size_t operator()(StrView str) const { return StrHash(str, true); }
+};
+
+struct StrFoldEqual
+{
+    using is_transparent = void;
+    bool operator()(StrView s1, StrView s2) const { return StrEqual(s1, s2, true); }
+};
+
+/**
+ * A set of strings compared case-insensitively, that keeps a single copy of each.
+ * The views returned remain valid for the lifetime of the set; the first spelling is kept.
+ */
+class StrInterner final
+{
+public:
+    StrView Intern(StrView str);
+    Optional<StrView> Find(StrView str) const;
+    size_t Size() const;
+private:
+    std::deque<String> m_strings; // stable addresses
+    std::unordered_set<StrView, StrFoldHash, StrFoldEqual> m_index;
+};
@@ -1,11 +1,17 @@
 #include "framework.hpp"
 
-typedef DWORD(__stdcall* RUNDLLFN)(INT, PWSTR[]);
+constexpr uint32_t EXELNK_FLAG_RAW  = 1 << 0;
+constexpr uint32_t EXELNK_FLAG_RANK = 1 << 1;
+constexpr uint32_t EXELNK_FLAG_RSP  = 1 << 2; // Write the arguments that do not fit in the command line to a UTF-8 response file.
+constexpr uint32_t EXELNK_FLAG_RSP16 = 1 << 3; // Same as `EXELNK_FLAG_RSP`, in UTF-16 LE with a BOM.
 
-constexpr uint32_t EXELNK_FLAG_RAW = 1 << 0;
+constexpr size_t EXELNK_CMDL_MAX = UNICODE_STRING_MAX_CHARS - 1; // CreateProcessW limit, without the null terminator
 
-#define READ_ADS_STR(_) ReadAds(modulePath, _).value_or(L"")
-#define READ_ADS_INT(_1, _2) StrToInt(READ_ADS_STR(_1)).value_or(_2)
+constexpr auto EXELNK_PAYLOAD_NAME = L"EXELNK";
+constexpr PCWSTR EXELNK_CONFIG_KEYS[] = { L"file", L"args", L"wdir", L"scmd", L"flags", L"resolve", L"env", L"path" };
+
+#define READ_CFG_STR(_) config.Get(_).value_or(L"")
+#define READ_CFG_INT(_1, _2) StrToInt(READ_CFG_STR(_1)).value_or(_2)
 
 #define CHECK_ERROR(e)                                        \
     if (!(e))                                                 \
@@ -25,6 +31,754 @@ static auto WriteAds(StrView path, StrView name, StrView text)
     return File::WriteText(std::format(L"{}:{}", path, name), text);
 }
 
+// Read the configuration embedded by `:EMBED:`, from the image already mapped in memory (this one by default).
+static Optional<Config> ReadPayload(HMODULE hModule = nullptr)
+{
+    const auto hResInfo = FindResourceW(hModule, EXELNK_PAYLOAD_NAME, RT_RCDATA);
+    const auto hResData = hResInfo ? LoadResource(hModule, hResInfo) : nullptr;
+    const auto data = hResData ? (const char*)LockResource(hResData) : nullptr;
+    if (!data) return std::nullopt;
+    return Config::ParsePayload({ data, SizeofResource(hModule, hResInfo) });
+}
+
+// Read the configuration from the streams of the file, if it has any.
+// The streams are listed first, so only those present are opened. A value not written by `:SET:`,
+// which the text form of the configuration would change, is ignored, so the broker serves the same one.
+static Optional<Config> ReadStreams(StrView path)
+{
+    Vector<PCWSTR> keys;
+    FileSystem::Native().EnumerateStreams(path,
+        [&](WIN32_FIND_STREAM_DATA* pfd) -> DWORD {
+            StrView name = pfd->cStreamName;
+            if (name.size() > 7 && name.ends_with(L":$DATA"))
+                name = name.substr(1, name.size() - 7);
+            for (const auto key : EXELNK_CONFIG_KEYS)
+                if (name == key)
+                    keys.push_back(key);
+            return NO_ERROR;
+        }
+    );
+    Optional<Config> config;
+    for (const auto key : keys)
+        if (const auto value = ReadAds(path, key); value && Config::IsValue(*value))
+        {
+            if (!config) config.emplace();
+            config->Set(key, *value);
+        }
+    return config;
+}
+
+// Copy this binary, and embed the configuration in the copy as a resource.
+// The running image cannot be modified, so the payload is written to a new file.
+static DWORD WritePayload(StrView modulePath, StrView path, const Config& config)
+{
+    const auto payload = config.ToPayload();
+    if (!CopyFileW(String(modulePath).data(), String(path).data(), FALSE))
+        return GetLastError();
+    const auto hUpdate = BeginUpdateResourceW(String(path).data(), FALSE);
+    if (!hUpdate) return GetLastError();
+    if (!UpdateResourceW(hUpdate, RT_RCDATA, EXELNK_PAYLOAD_NAME, MAKELANGID(LANG_NEUTRAL, SUBLANG_NEUTRAL),
+        (PVOID)payload.data(), (DWORD)payload.size()))
+    {
+        const auto error = GetLastError();
+        EndUpdateResourceW(hUpdate, TRUE);
+        return error;
+    }
+    return EndUpdateResourceW(hUpdate, FALSE) ? NO_ERROR : GetLastError();
+}
+
+// Parse path resolution options: "threads=<n> depth=<n> deadline=<ms> entries=<n> backtracks=<n> memo".
+static auto ParseResolveOptions(StrView text, PathResolveOptions& options)
+{
+    for (const auto part : text | std::views::split(L' '))
+    {
+        const StrView option(part.begin(), part.end());
+        if (option == L"memo") options.flags |= PATH_RESOLVE_FLAG_MEMO;
+        const auto pos = option.find(L'=');
+        if (pos == option.npos) continue;
+        const auto name = option.substr(0, pos);
+        const auto value = (uint32_t)StrToInt(String(option.substr(pos + 1))).value_or(0);
+        if (name == L"threads") options.threads = value;
+        else if (name == L"depth") options.depth = value;
+        else if (name == L"deadline") options.deadline = value;
+        else if (name == L"entries") options.maxEntries = value;
+        else if (name == L"backtracks") options.maxBacktracks = value;
+    }
+}
+
+// Whether the resolution options text has the option word.
+static bool HasOption(StrView text, StrView name)
+{
+    for (const auto part : text | std::views::split(L' '))
+        if (StrView(part.begin(), part.end()) == name)
+            return true;
+    return false;
+}
+
+// Print the statistics of a resolution as lines of JSON: one for each segment of the pattern, then the result.
+static void PrintResolveTrace(const Path& pattern, StrView result, DWORD error, const PathResolveStats& stats)
+{
+    PathResolveSegmentStats total;
+    for (size_t i = 0; i < stats.segments.size(); ++i)
+    {
+        const auto& segment = stats.segments[i];
+        PRINT(L"{{\"segment\":{},\"pattern\":{},\"enumerations\":{},\"entries\":{},\"descents\":{},\"backtracks\":{},\"streams\":{},\"probes\":{},\"us\":{}}}",
+            i, JsonQuote(i < pattern.SegmentCount() ? pattern.Segment(i) : L""), segment.enumerations, segment.entries,
+            segment.descents, segment.backtracks, segment.streams, segment.probes, segment.microseconds);
+        total.enumerations += segment.enumerations;
+        total.entries += segment.entries;
+        total.descents += segment.descents;
+        total.backtracks += segment.backtracks;
+        total.streams += segment.streams;
+        total.probes += segment.probes;
+    }
+    PRINT(L"{{\"pattern\":{},\"path\":{},\"error\":{},\"enumerations\":{},\"entries\":{},\"descents\":{},\"backtracks\":{},\"streams\":{},\"probes\":{},"
+        L"\"memo_hits\":{},\"memo_negative_hits\":{},\"memo_misses\":{},\"us\":{}}}",
+        JsonQuote(pattern.ToString()), JsonQuote(result), error, total.enumerations, total.entries, total.descents, total.backtracks,
+        total.streams, total.probes, stats.memoHits, stats.memoNegativeHits, stats.memoMisses, stats.microseconds);
+}
+
+// The value of the resolution option "<name>=<value>", if any.
+static Optional<uint32_t> GetOptionValue(StrView text, StrView name)
+{
+    for (const auto part : text | std::views::split(L' '))
+    {
+        const StrView option(part.begin(), part.end());
+        if (option.size() > name.size() && option.starts_with(name) && option[name.size()] == L'=')
+            return (uint32_t)StrToInt(String(option.substr(name.size() + 1))).value_or(0);
+    }
+    return std::nullopt;
+}
+
+// Whether the path has wildcards, or alternatives separated by `|`.
+static bool IsResolvable(StrView text)
+{
+    return text.find(L'|') != text.npos || Path::IsPattern(text);
+}
+
+// Whether an alternative of the path is relative to the current directory, or to the current directory of a drive.
+static bool IsRelative(StrView text)
+{
+    for (const auto part : text | std::views::split(L'|'))
+    {
+        const Path path(StrView(part.begin(), part.end()));
+        if (!part.empty() && !path.IsAbsolute() && !path.IsDevice())
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Resolve path wildcards, reusing the result cached in the `<name>.cache` stream if still valid.
+ * The result is added to `resolutions`, to detect when the path must be resolved again.
+ * If a resolution limit is reached and `fallback` is set, the last result is used while its target exists.
+ * The text may list alternatives separated by `|`, resolved with `ResolveHedged`: the result is cached
+ * only if the earlier alternatives were not found, since those cancelled have not recorded all their directories.
+ */
+static auto ResolvePath(StrView modulePath, StrView text, Path& path, StrView name, PathResolveOptions options, DWORD hedge, bool fallback, Vector<ResolveCache>& resolutions)
+{
+    const auto& fs = *options.fs;
+    const auto stream = std::format(L"{}.cache", name);
+
+    // The resolution flags are part of the key, since they may change the result.
+    Vector<Path> alternatives;
+    auto pattern = std::format(L"{}", options.flags & ~PATH_RESOLVE_FLAG_MEMO);
+    for (const auto part : text | std::views::split(L'|'))
+    {
+        if (part.empty())
+            continue;
+        auto& alternative = alternatives.emplace_back(StrView(part.begin(), part.end()));
+        alternative.MakeAbsolute();
+        pattern += std::format(L"|{}", alternative.ToString());
+    }
+    if (alternatives.empty())
+        return (DWORD)ERROR_FILE_NOT_FOUND;
+    path = alternatives[0];
+
+    const auto cache = ResolveCache::Parse(ReadAds(modulePath, stream).value_or(L""));
+    if (cache && cache->Pattern() == pattern && cache->IsValid(fs))
+    {
+        path = Path(cache->Target());
+        resolutions.push_back(*cache);
+        return (DWORD)ERROR_RESOURCE_ENUM_USER_STOP;
+    }
+
+    ResolveCache result(pattern);
+    DWORD error;
+    bool complete = true;
+    if (alternatives.size() == 1)
+    {
+        const ResolveCacheRecorder recorder(fs, result);
+        options.fs = &recorder;
+        error = path.Resolve(options);
+    }
+    else
+    {
+        // Each alternative records its directories.
+        Vector<ResolveCache> caches(alternatives.size(), ResolveCache(pattern));
+        Vector<DWORD> errors;
+        const auto index = ResolveHedged(alternatives.size(), hedge,
+            [&](size_t k, const std::atomic<bool>& cancel) -> DWORD {
+                auto& alternative = alternatives[k];
+                auto& cache = caches[k];
+                const ResolveCacheRecorder recorder(*options.fs, cache);
+                auto resolveOptions = options;
+                resolveOptions.fs = &recorder;
+                resolveOptions.cancel = &cancel;
+                return alternative.Resolve(resolveOptions);
+            },
+            errors
+        );
+        // Report the first limit reached, if none is found.
+        error = errors[0];
+        for (const auto e : errors)
+            if (e == ERROR_TIMEOUT || e == ERROR_NOT_ENOUGH_QUOTA)
+            {
+                error = e;
+                break;
+            }
+        // An alternative cancelled has not listed all its directories, so the merge stops before it.
+        for (size_t k = 0; complete && k < std::min(index + 1, errors.size()); ++k)
+        {
+            complete = k == index || (errors[k] != ERROR_CANCELLED
+                && errors[k] != ERROR_TIMEOUT && errors[k] != ERROR_NOT_ENOUGH_QUOTA);
+            if (complete) result.Merge(caches[k]);
+        }
+        if (index < errors.size())
+        {
+            path = alternatives[index];
+            error = ERROR_RESOURCE_ENUM_USER_STOP;
+        }
+    }
+    if (error == ERROR_RESOURCE_ENUM_USER_STOP && complete)
+    {
+        result.SetTarget(path);
+        WriteAds(modulePath, stream, result.ToString());
+    }
+    resolutions.push_back(std::move(result));
+    // The result without a target is kept in `resolutions`, so the path is resolved again the next time.
+    if ((error == ERROR_TIMEOUT || error == ERROR_NOT_ENOUGH_QUOTA) && fallback
+        && cache && cache->Pattern() == pattern && fs.Exists(cache->Target()))
+    {
+        path = Path(cache->Target());
+        return (DWORD)ERROR_RESOURCE_ENUM_USER_STOP;
+    }
+    return error;
+}
+
+/**
+ * Write the arguments to a new temporary response file, one per line.
+ * The arguments are encoded and written in chunks, as they are quoted.
+ */
+static Optional<String> WriteResponseFile(std::span<const StrView> args, BOOL raw, bool utf16)
+{
+    wchar_t directory[MAX_PATH + 1], path[MAX_PATH];
+    if (!GetTempPathW(MAX_PATH + 1, directory) || !GetTempFileNameW(directory, L"elk", 0, path))
+        return std::nullopt;
+    const File file(path, GENERIC_WRITE, 0, CREATE_ALWAYS);
+    std::string chunk;
+    String line;
+    bool result = !!file;
+    if (utf16) chunk.append("\xFF\xFE");
+    for (size_t i = 0; result && i <= args.size(); ++i)
+    {
+        if (i < args.size())
+        {
+            line.clear();
+            AppendArgument(line, args[i], raw).append(L"\r\n");
+            if (utf16)
+                chunk.append((const char*)line.data(), line.size() * sizeof(wchar_t));
+            else
+            {
+                const auto offset = chunk.size();
+                chunk.resize(offset + line.size() * 3);
+                chunk.resize(offset + WideCharToMultiByte(CP_UTF8, 0, line.data(), (INT)line.size(),
+                    chunk.data() + offset, (INT)(chunk.size() - offset), nullptr, nullptr));
+            }
+        }
+        if (chunk.size() >= 0x10000 || (i == args.size() && !chunk.empty()))
+        {
+            result = file.Write(chunk.data(), chunk.size()).has_value();
+            chunk.clear();
+        }
+    }
+    if (!result)
+    {
+        const auto error = GetLastError();
+        DeleteFileW(path);
+        SetLastError(error);
+        return std::nullopt;
+    }
+    return path;
+}
+
+// The number of hard links of the file, which share its data streams.
+static DWORD GetLinkCount(StrView path, DWORD& links)
+{
+    const auto hFile = CreateFileW(String(path).data(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return GetLastError();
+    BY_HANDLE_FILE_INFORMATION info;
+    const auto error = GetFileInformationByHandle(hFile, &info) ? NO_ERROR : GetLastError();
+    CloseHandle(hFile);
+    links = error == NO_ERROR ? info.nNumberOfLinks : 0;
+    return error;
+}
+
+/**
+ * Create the shims of a manifest in the directory, as copies of this binary configured in their own streams,
+ * since hard links would share them. An existing hard link, such as one made by `:CAT:`, is replaced by a copy.
+ * The shims are written in parallel; the streams that already hold their value are not written again,
+ * so provisioning again only writes what has changed.
+ */
+static DWORD GenerateShims(const Path& modulePath, const Vector<std::pair<String, Config>>& configs, StrView directory)
+{
+    // The names are compared case-insensitively, like the file names.
+    Vector<String> names;
+    for (const auto& [name, config] : configs)
+        names.push_back(StrFoldCase(name));
+    std::ranges::sort(names);
+    if (std::ranges::adjacent_find(names) != names.end())
+    {
+        PRINT(L"[{}] {}", ERROR_DUP_NAME, SystemErrorToString(ERROR_DUP_NAME));
+        return ERROR_DUP_NAME;
+    }
+
+    enum class Change { Unchanged, Created, Updated };
+    Vector<std::pair<Change, DWORD>> results(configs.size(), { Change::Unchanged, NO_ERROR });
+    std::atomic<size_t> next = 0;
+    const auto work = [&]() {
+        for (size_t k; (k = next++) < configs.size(); )
+        {
+            const auto& [name, config] = configs[k];
+            auto& [change, error] = results[k];
+            const auto path = std::format(L"{}\\{}.exe", directory, name);
+            DWORD links = 0;
+            if (error = GetLinkCount(path, links); error != NO_ERROR && error != ERROR_FILE_NOT_FOUND)
+                continue;
+            error = NO_ERROR;
+            // Removing the name leaves the other links, and their streams, as they are.
+            if (links > 1 && !DeleteFileW(path.data()))
+            {
+                error = GetLastError();
+                continue;
+            }
+            if (links != 1)
+            {
+                if (!CopyFileW(modulePath, path.data(), TRUE))
+                {
+                    error = GetLastError();
+                    continue;
+                }
+                change = links ? Change::Updated : Change::Created;
+            }
+            // The copy also has the streams of this binary, which are replaced or deleted as well.
+            for (const auto key : EXELNK_CONFIG_KEYS)
+            {
+                const auto value = config.Get(key);
+                if (ReadAds(path, key) == value)
+                    continue;
+                const auto stream = std::format(L"{}:{}", path, key);
+                if (value ? !File::WriteText(stream, *value) : !DeleteFileW(stream.data()))
+                {
+                    error = GetLastError();
+                    break;
+                }
+                if (change == Change::Unchanged)
+                    change = Change::Updated;
+            }
+        }
+    };
+
+    // The work is mostly waiting for the file system, so all the processors are used.
+    const auto count = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), configs.size());
+    Vector<std::jthread> workers;
+    for (size_t n = 1; n < count; ++n)
+        workers.emplace_back(work);
+    work();
+    workers.clear();
+
+    DWORD result = NO_ERROR;
+    size_t created = 0, updated = 0, unchanged = 0, failed = 0;
+    for (size_t k = 0; k < configs.size(); ++k)
+    {
+        const auto [change, error] = results[k];
+        if (error == NO_ERROR && change == Change::Unchanged)
+        {
+            ++unchanged;
+            continue;
+        }
+        if (error != NO_ERROR)
+        {
+            ++failed;
+            result = error;
+        }
+        else
+            ++(change == Change::Created ? created : updated);
+        PRINT(L"[{}] {}\n\"{}\\{}.exe\"", error, SystemErrorToString(error), directory, configs[k].first);
+    }
+    PRINT(L"{} created, {} updated, {} unchanged, {} failed", created, updated, unchanged, failed);
+    return result;
+}
+
+/**
+ * Resolve the alternatives of a configured path in order, for `:SCAN:`, and return the result as JSON.
+ * A wildcard match is ambiguous if the pattern has another match, found by searching again with the first one hidden.
+ */
+static String ScanPath(StrView text, const PathResolveOptions& options, DWORD& error, bool& ambiguous)
+{
+    Optional<Path> found;
+    String other;
+    DWORD firstError = NO_ERROR;
+    for (const auto part : text | std::views::split(L'|'))
+    {
+        if (part.empty())
+            continue;
+        Path path(StrView(part.begin(), part.end()));
+        path.MakeAbsolute();
+        const auto pattern = path;
+        const auto result = path.Resolve(options);
+        // Report the error of the first alternative, if none is found.
+        if (result != ERROR_RESOURCE_ENUM_USER_STOP && result != NO_ERROR)
+        {
+            if (firstError == NO_ERROR)
+                firstError = result;
+            continue;
+        }
+        if (Path::IsPattern(pattern))
+        {
+            const MaskFileSystem mask(*options.fs, path);
+            auto again = pattern;
+            auto maskOptions = options;
+            maskOptions.fs = &mask;
+            if (again.Resolve(maskOptions) == ERROR_RESOURCE_ENUM_USER_STOP)
+                other = again.ToString();
+        }
+        found = std::move(path);
+        break;
+    }
+    error = found ? NO_ERROR : firstError != NO_ERROR ? firstError : ERROR_FILE_NOT_FOUND;
+    ambiguous = !other.empty();
+    return std::format(L"{{\"pattern\":{},\"path\":{},\"error\":{},\"ambiguous\":{}}}", JsonQuote(text),
+        found ? JsonQuote(*found) : L"null", error, ambiguous ? JsonQuote(other) : L"null");
+}
+
+/**
+ * Scan the shims in the directory, resolve their targets and working directories, and print them as JSON lines.
+ * A configuration is read like the shim does: from the payload, the catalog, or the streams listed.
+ * The shims are scanned by a pool of threads, which share the queries, since the targets usually share prefixes;
+ * the resolutions without a deadline are bounded by the one of the scan.
+ * Options: "threads=<n> deadline=<ms>".
+ */
+static DWORD ScanShims(StrView directory, StrView optionsText)
+{
+    const auto& native = FileSystem::Native();
+    const auto start = std::chrono::steady_clock::now();
+    Vector<String> names;
+    const auto error = native.EnumerateFiles(std::format(L"{}\\*.exe", directory),
+        [&](const FileEntry& entry) -> DWORD {
+            // The pattern also matches the short names, of longer extensions.
+            if (!BITALL(entry.attributes, FILE_ATTRIBUTE_DIRECTORY)
+                && entry.name.size() > 4 && StrEqual(entry.name.substr(entry.name.size() - 4), L".exe", true))
+                names.emplace_back(entry.name);
+            return NO_ERROR;
+        }
+    );
+    if (error != ERROR_NO_MORE_FILES && error != ERROR_FILE_NOT_FOUND)
+    {
+        PRINT(L"[{}] {}", error, SystemErrorToString(error));
+        return error;
+    }
+
+    const Catalog catalog(std::format(L"{}\\{}", directory, CATALOG_FILE_NAME));
+    const MemoFileSystem memo(native);
+    const auto deadline = GetOptionValue(optionsText, L"deadline").value_or(2000);
+    const auto threads = GetOptionValue(optionsText, L"threads").value_or(std::thread::hardware_concurrency());
+
+    struct Report
+    {
+        String json;
+        bool configured = false;
+        bool ambiguous = false;
+        DWORD error = NO_ERROR; // first path not found
+    };
+    Vector<Report> reports(names.size());
+    std::atomic<size_t> next = 0;
+    const auto work = [&]() {
+        for (size_t k; (k = next++) < names.size(); )
+        {
+            const auto shimStart = std::chrono::steady_clock::now();
+            auto& report = reports[k];
+            const auto path = std::format(L"{}\\{}", directory, names[k]);
+            auto alias = StrView(names[k]);
+            alias.remove_suffix(4);
+
+            Optional<Config> config;
+            StrView source = L"null";
+            if (const auto hModule = LoadLibraryExW(path.data(), nullptr, LOAD_LIBRARY_AS_DATAFILE | LOAD_LIBRARY_AS_IMAGE_RESOURCE))
+            {
+                config = ReadPayload(hModule);
+                FreeLibrary(hModule);
+                if (config) source = L"\"payload\"";
+            }
+            if (!config && catalog)
+                if (const auto entry = catalog.Find(alias))
+                {
+                    config = Config::Parse(*entry);
+                    if (config) source = L"\"catalog\"";
+                }
+            if (!config && (config = ReadStreams(path)))
+                source = L"\"streams\"";
+
+            String file = L"null", wdir = L"null";
+            if (config)
+            {
+                report.configured = true;
+                PathResolveOptions options { .fs = &memo };
+                ParseResolveOptions(config->Get(L"resolve").value_or(L""), options);
+                options.flags &= ~PATH_RESOLVE_FLAG_MEMO;
+                if (BITALL(StrToInt(config->Get(L"flags").value_or(L"")).value_or(0), EXELNK_FLAG_RANK))
+                    options.flags |= PATH_RESOLVE_FLAG_RANK;
+                options.threads = 1; // the shims are scanned in parallel instead
+                if (!options.deadline)
+                    options.deadline = deadline;
+                DWORD pathError;
+                bool ambiguous;
+                if (const auto text = config->Get(L"file"))
+                {
+                    file = ScanPath(*text, options, pathError, ambiguous);
+                    report.ambiguous = ambiguous;
+                    report.error = pathError;
+                }
+                if (const auto text = config->Get(L"wdir"))
+                {
+                    wdir = ScanPath(*text, options, pathError, ambiguous);
+                    report.ambiguous = report.ambiguous || ambiguous;
+                    if (report.error == NO_ERROR)
+                        report.error = pathError;
+                }
+            }
+            report.json = std::format(L"{{\"shim\":{},\"source\":{},\"file\":{},\"wdir\":{},\"broken\":{},\"us\":{}}}",
+                JsonQuote(path), source, file, wdir, report.error != NO_ERROR,
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - shimStart).count());
+        }
+    };
+
+    const auto count = std::min<size_t>(std::max(threads, 1u), names.size());
+    Vector<std::jthread> workers;
+    for (size_t n = 1; n < count; ++n)
+        workers.emplace_back(work);
+    work();
+    workers.clear();
+
+    DWORD result = NO_ERROR;
+    size_t configured = 0, broken = 0, ambiguous = 0;
+    for (const auto& report : reports)
+    {
+        PRINT(L"{}", report.json);
+        configured += report.configured;
+        ambiguous += report.ambiguous;
+        if (report.error != NO_ERROR)
+        {
+            ++broken;
+            result = report.error;
+        }
+    }
+    PRINT(L"{{\"shims\":{},\"configured\":{},\"broken\":{},\"ambiguous\":{},\"memo_hits\":{},\"memo_misses\":{},\"us\":{}}}",
+        names.size(), configured, broken, ambiguous, memo.Hits(), memo.Misses(),
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    return result;
+}
+
+/**
+ * Read the configuration of the shim, and resolve the wildcards in its paths.
+ * The configuration is read from the payload embedded in the binary, if any.
+ * Shims that are links to a shared binary are configured in the catalog next to it,
+ * since links share the streams; otherwise, the configuration is read from the streams.
+ * With the `broker` resolution option, the resolved configuration is requested from the broker, if running.
+ * `broker` is set when called by the broker itself, which reads neither its own payload nor the broker,
+ * and keeps the last write time of the files read, to detect changes.
+ */
+static LaunchConfig LoadLaunchConfig(const Path& modulePath, bool broker)
+{
+    const auto& fs = FileSystem::Native();
+    LaunchConfig launch;
+    String cachePrefix;
+
+    auto config = broker ? std::nullopt : ReadPayload();
+    const auto hasPayload = config.has_value();
+    if (!config)
+    {
+        auto alias = modulePath.Name();
+        if (alias.size() > 4 && StrEqual(alias.substr(alias.size() - 4), L".exe", true))
+            alias.remove_suffix(4);
+        // The last write time is taken before reading, so concurrent changes invalidate the result kept by the broker.
+        const auto catalogPath = std::format(L"{}\\{}", modulePath.ToString(-1), CATALOG_FILE_NAME);
+        if (broker)
+            launch.sources.emplace_back(catalogPath, fs.GetLastWriteTime(catalogPath).value_or(0));
+        const Catalog catalog(catalogPath);
+        if (const auto entry = catalog.Find(alias))
+        {
+            config = Config::Parse(*entry);
+            cachePrefix = std::format(L"{}.", alias);
+        }
+    }
+    if (!config)
+    {
+        if (broker)
+            launch.sources.emplace_back(modulePath, fs.GetLastWriteTime(modulePath).value_or(0));
+        config = ReadStreams(modulePath).value_or(Config());
+    }
+
+    const auto fileText = config->Get(L"file").value_or(L"");
+    const auto wdirText = config->Get(L"wdir").value_or(L"");
+    const auto flags = (uint32_t)StrToInt(config->Get(L"flags").value_or(L"")).value_or(0);
+
+    PathResolveOptions options;
+    const auto resolve = config->Get(L"resolve").value_or(L"");
+    ParseResolveOptions(resolve, options);
+    const auto fallback = HasOption(resolve, L"fallback");
+    const auto hedge = GetOptionValue(resolve, L"hedge").value_or(INFINITE);
+    if (BITALL(flags, EXELNK_FLAG_RANK))
+        options.flags |= PATH_RESOLVE_FLAG_RANK;
+
+    // Shims with a payload need no I/O, so they do not ask the broker.
+    if (!broker && !hasPayload && HasOption(resolve, L"broker") && (IsResolvable(fileText) || IsResolvable(wdirText)))
+    {
+        if (auto resolved = Broker::Request(modulePath))
+            return std::move(*resolved);
+    }
+
+    // The file and working directory patterns usually share a prefix, so they share the memo.
+    // Alternatives are resolved concurrently by threads, and keep their own.
+    const MemoFileSystem memo(*options.fs);
+    const auto hasAlternatives = fileText.find(L'|') != String::npos || wdirText.find(L'|') != String::npos;
+    if (BITALL(options.flags, PATH_RESOLVE_FLAG_MEMO) && !hasAlternatives)
+    {
+        options.flags &= ~PATH_RESOLVE_FLAG_MEMO;
+        options.fs = &memo;
+    }
+
+    // Resolve path wildcards with `FindFirstFileExW`.
+    // This is done depth first, one path segment at a time.
+    // A resolution limit reached is reported, instead of launching the pattern.
+    const auto checkLimit = [&](DWORD error) {
+        if ((error == ERROR_TIMEOUT || error == ERROR_NOT_ENOUGH_QUOTA) && launch.error == NO_ERROR)
+            launch.error = error;
+    };
+    launch.relative = (IsResolvable(fileText) && IsRelative(fileText)) || (IsResolvable(wdirText) && IsRelative(wdirText));
+    if (IsResolvable(fileText))
+    {
+        Path file(L"");
+        checkLimit(ResolvePath(modulePath, fileText, file, cachePrefix + L"file", options, hedge, fallback, launch.resolutions));
+        config->Set(L"file", file);
+    }
+    if (IsResolvable(wdirText))
+    {
+        Path wdir(L"");
+        checkLimit(ResolvePath(modulePath, wdirText, wdir, cachePrefix + L"wdir", options, hedge, fallback, launch.resolutions));
+        config->Set(L"wdir", wdir);
+    }
+
+    launch.config = std::move(*config);
+    return launch;
+}
+
+// Launch the target file, returning its process information.
+// The configuration and buffers are released on return, before waiting for the process.
+// A response file is returned in `responseFile`, to be deleted once the process exits.
+static DWORD Launch(const Path& modulePath, const Config& config, Vector<StrView> args, bool isFinalProcess, PROCESS_INFORMATION& pi, String& responseFile)
+{
+    const auto moduleName = modulePath.Name();
+
+    auto file = Path(READ_CFG_STR(L"file"));
+    auto wdir = Path(READ_CFG_STR(L"wdir"));
+    auto scmd = (WORD)READ_CFG_INT(L"scmd", SW_NORMAL);
+    auto flags = (uint32_t)READ_CFG_INT(L"flags", 0);
+    
+    if (args.size() && args[0] == L":RAW:")
+    {
+        args.erase(args.begin());
+        flags |= EXELNK_FLAG_RAW;
+    }
+
+    if (!file.Type())
+    {
+        PRINT(L"INFO: file not set or invalid, run:");
+        PRINT(L"\t{} :SET: file <path>", moduleName);
+        return NO_ERROR;
+    }
+
+    // Build command line, sized in a first pass so that it is allocated once.
+    const auto fileArgs = READ_CFG_STR(L"args");
+    const auto raw = BITALL(flags, EXELNK_FLAG_RAW);
+    auto length = ArgumentLength(file.Name()) + 1 + ArgumentLength(fileArgs, TRUE);
+    auto count = args.size(); // arguments written in the command line
+    for (const auto& arg : args)
+        length += 1 + ArgumentLength(arg, raw);
+
+    // The arguments that exceed the limit are moved to a response file, passed as `@<path>`.
+    if (length > EXELNK_CMDL_MAX && (flags & (EXELNK_FLAG_RSP | EXELNK_FLAG_RSP16)))
+    {
+        constexpr auto reserve = MAX_PATH + 4; // ` "@<path>"`
+        length = ArgumentLength(file.Name()) + 1 + ArgumentLength(fileArgs, TRUE);
+        for (count = 0; count < args.size(); ++count)
+        {
+            const auto n = 1 + ArgumentLength(args[count], raw);
+            if (length + n + reserve > EXELNK_CMDL_MAX) break;
+            length += n;
+        }
+        const auto path = WriteResponseFile(std::span(args).subspan(count), raw, BITALL(flags, EXELNK_FLAG_RSP16));
+        CHECK_ERROR(path);
+        responseFile = *path;
+        length += reserve;
+    }
+
+    String cmdl;
+    cmdl.reserve(length);
+    AppendArgument(cmdl, file.Name());
+    AppendArgument(cmdl, fileArgs, TRUE);
+    for (size_t i = 0; i < count; ++i)
+        AppendArgument(cmdl, args[i], raw);
+    if (!responseFile.empty())
+        AppendArgument(cmdl, std::format(L"@{}", responseFile));
+
+    DWORD creationFlags = 0;
+
+    if (isFinalProcess)
+        creationFlags |= CREATE_NEW_CONSOLE | CREATE_NEW_PROCESS_GROUP;
+
+    // Merge the environment changes into a copy of the current environment block.
+    // If the block is not sorted, the changes are made to this process instead, and inherited.
+    Optional<String> environment;
+    if (const auto env = Environment::Parse(READ_CFG_STR(L"env"), READ_CFG_STR(L"path")); !env.Empty())
+    {
+        if (const auto block = GetEnvironmentStringsW())
+        {
+            environment = env.Merge(block);
+            FreeEnvironmentStringsW(block);
+        }
+        if (environment)
+            creationFlags |= CREATE_UNICODE_ENVIRONMENT;
+        else
+            env.Apply();
+    }
+
+    STARTUPINFOW si { .cb = sizeof(STARTUPINFOW), .dwFlags = STARTF_USESHOWWINDOW, .wShowWindow = scmd };
+    if (!CreateProcessW(file, cmdl.data(), nullptr, nullptr, FALSE, creationFlags,
+        environment ? environment->data() : nullptr, wdir, &si, &pi))
+    {
+        const auto error = GetLastError();
+        if (!responseFile.empty())
+            DeleteFileW(responseFile.data());
+        PRINT(L"[{}] {}", error, SystemErrorToString(error));
+        return error;
+    }
+
+    return NO_ERROR;
+}
+
 INT wmain(INT argc, PWSTR argv[])
 {
     DWORD consoleProcessList; // https://stackoverflow.com/a/64842606/14822191
@@ -47,6 +801,14 @@ INT wmain(INT argc, PWSTR argv[])
         {
             if (args.size() >= 3)
             {
+                // The configuration is also served in its text form, by the catalog and the broker,
+                // so a value that the text form would change is rejected.
+                const auto isKey = std::ranges::any_of(EXELNK_CONFIG_KEYS, [&](StrView key) -> bool { return StrEqual(key, args[1], true); });
+                if (isKey && !Config::IsValue(args[2]))
+                {
+                    PRINT(L"[{}] {}", ERROR_INVALID_DATA, SystemErrorToString(ERROR_INVALID_DATA));
+                    return ERROR_INVALID_DATA;
+                }
                 const auto result = WriteAds(modulePath, args[1], args[2]);
                 const auto error = result ? NO_ERROR : GetLastError();
                 PRINT(L"[{}] {}", error, SystemErrorToString(error));
@@ -55,99 +817,261 @@ INT wmain(INT argc, PWSTR argv[])
             PRINT(L"Usage:\n\t{} :SET: <name> <value>", moduleName);
             return NO_ERROR;
         }
+        // Compile a manifest into the catalog, and link the shims to this binary.
+        if (args[0] == L":CAT:")
+        {
+            if (args.size() >= 2)
+            {
+                const auto input = File::ReadBytes(args[1]);
+                CHECK_ERROR(input);
+                const auto configs = Config::ParseManifest(DecodeText(*input));
+                if (!configs)
+                {
+                    PRINT(L"[{}] {}", ERROR_INVALID_DATA, SystemErrorToString(ERROR_INVALID_DATA));
+                    return ERROR_INVALID_DATA;
+                }
+                const auto directory = modulePath.ToString(-1);
+                auto error = Catalog::Write(std::format(L"{}\\{}", directory, CATALOG_FILE_NAME), *configs);
+                PRINT(L"[{}] {}", error, SystemErrorToString(error));
+                if (error != NO_ERROR) return error;
+                for (const auto& [name, config] : *configs)
+                {
+                    const auto link = std::format(L"{}\\{}.exe", directory, name);
+                    if (FileSystem::Native().Exists(link))
+                        continue;
+                    error = CreateHardLinkW(link.data(), modulePath, nullptr) ? NO_ERROR : GetLastError();
+                    PRINT(L"[{}] {}\n\"{}\"", error, SystemErrorToString(error), link);
+                }
+                return error;
+            }
+            PRINT(L"Usage:\n\t{} :CAT: <manifest>", moduleName);
+            return NO_ERROR;
+        }
+        // Create the shims of a manifest, as copies of this binary configured in their streams.
+        if (args[0] == L":GEN:")
+        {
+            if (args.size() >= 2)
+            {
+                const auto input = File::ReadBytes(args[1]);
+                CHECK_ERROR(input);
+                const auto configs = Config::ParseManifest(DecodeText(*input));
+                if (!configs)
+                {
+                    PRINT(L"[{}] {}", ERROR_INVALID_DATA, SystemErrorToString(ERROR_INVALID_DATA));
+                    return ERROR_INVALID_DATA;
+                }
+                const String directory(args.size() >= 3 ? args[2] : modulePath.ToString(-1));
+                return GenerateShims(modulePath, *configs, directory);
+            }
+            PRINT(L"Usage:\n\t{} :GEN: <manifest> [directory]", moduleName);
+            return NO_ERROR;
+        }
+        // Copy this binary with its configuration embedded.
+        if (args[0] == L":EMBED:")
+        {
+            if (args.size() >= 2)
+            {
+                auto config = ReadPayload().value_or(Config());
+                for (const auto key : EXELNK_CONFIG_KEYS)
+                    if (const auto value = ReadAds(modulePath, key); value && Config::IsValue(*value))
+                        config.Set(key, *value);
+                const auto error = WritePayload(modulePath, args[1], config);
+                PRINT(L"[{}] {}", error, SystemErrorToString(error));
+                return error;
+            }
+            PRINT(L"Usage:\n\t{} :EMBED: <path>", moduleName);
+            return NO_ERROR;
+        }
         // Run DLL function.
         if (args[0] == L":DLL:")
         {
             if (args.size() >= 3)
             {
-                HMODULE hModule; FARPROC fn = nullptr;
-                CHECK_ERROR(hModule = LoadLibraryW(args[1].data()));
-                // Look up by ordinal.
-                if (args[2].starts_with(L'#'))
+                // Call through the resident host if there is one, or load the module.
+                const std::span<const PWSTR> fnArgs(argv + 4, argc - 4);
+                if (const auto result = DllHost::CallRemote(args[1], args[2], fnArgs))
                 {
-                    auto ord = StrToInt(args[2].data() + 1);
-                    if (ord && !IS_INTRESOURCE(*ord)) ord.reset();
-                    auto ordinal = MAKEINTRESOURCEA(ord.value_or(0));
-                    CHECK_ERROR(fn = GetProcAddress(hModule, ordinal));
+                    const auto [error, exitCode] = *result;
+                    if (error != NO_ERROR)
+                    {
+                        PRINT(L"[{}] {}", error, SystemErrorToString(error));
+                        return error;
+                    }
+                    PRINT(L"[{}] {}", exitCode, SystemErrorToString(exitCode));
+                    return exitCode;
                 }
-                // Look up by name.
-                else
+                DllHost host;
+                RUNDLLFN fn;
+                if (const auto error = host.Find(args[1], args[2], fn); error != NO_ERROR)
                 {
-                    #pragma warning(suppress: 4244) // narrow cast (wchar_t → char)
-                    const auto name = std::string(args[2].begin(), args[2].end());
-                    CHECK_ERROR(fn = GetProcAddress(hModule, name.data()));
+                    PRINT(L"[{}] {}", error, SystemErrorToString(error));
+                    return error;
                 }
-                const auto error = RUNDLLFN(fn)(argc - 4, argv + 4);
+                const auto error = fn(argc - 4, argv + 4);
                 PRINT(L"[{}] {}", error, SystemErrorToString(error));
                 return error;
             }
             PRINT(L"Usage:\n\t{} :DLL: <path> <function> [...args]", moduleName);
             return NO_ERROR;
         }
+        // Keep the launch configurations of the shims in a resident process.
+        if (args[0] == L":BROKER:")
+        {
+            Broker broker(
+                [](StrView path) -> LaunchConfig {
+                    return LoadLaunchConfig(Path(path), true);
+                }
+            );
+            const auto error = broker.Serve();
+            PRINT(L"[{}] {}", error, SystemErrorToString(error));
+            return error;
+        }
+        // Serve DLL function calls from a resident process.
+        if (args[0] == L":DLLHOST:")
+        {
+            DllHost host;
+            const auto error = host.Serve();
+            PRINT(L"[{}] {}", error, SystemErrorToString(error));
+            return error;
+        }
         // Resolve path.
         if (args[0] == L":FIND:")
         {
             if (args.size() >= 2)
             {
                 Path path(args[1]);
-                const auto error = path.Resolve();
+                PathResolveOptions options;
+                if (args.size() >= 3)
+                    ParseResolveOptions(args[2], options);
+                PathResolveStats stats;
+                options.stats = &stats;
+                path.MakeAbsolute();
+                const auto pattern = path;
+                const auto error = path.Resolve(options);
+                // Print the work done at each segment, to find the patterns that are slow to search.
+                if (args.size() >= 3 && HasOption(args[2], L"trace"))
+                {
+                    PrintResolveTrace(pattern, path, error, stats);
+                    return error;
+                }
                 PRINT(L"[{}] {}\n\"{}\"", error, SystemErrorToString(error), (StrView)path);
+                if (BITALL(options.flags, PATH_RESOLVE_FLAG_MEMO))
+                    PRINT(L"memo: {} hits ({} not found), {} misses", stats.memoHits, stats.memoNegativeHits, stats.memoMisses);
                 return error;
             }
-            PRINT(L"Usage:\n\t{} :FIND: <path>", moduleName);
+            PRINT(L"Usage:\n\t{} :FIND: <path> [options]", moduleName);
             return NO_ERROR;
         }
-    }
+        // Resolve newline or null separated paths, read from a file or the standard input.
+        if (args[0] == L":FINDALL:")
+        {
+            const auto input = args.size() >= 2 && args[1] != L"-"
+                ? File::ReadBytes(args[1])
+                : ReadAll(GetStdHandle(STD_INPUT_HANDLE));
+            CHECK_ERROR(input);
+            PathResolveOptions options;
+            if (args.size() >= 3)
+                ParseResolveOptions(args[2], options);
+            const auto trace = args.size() >= 3 && HasOption(args[2], L"trace");
+            // The paths usually share prefixes, which are enumerated only once.
+            const MemoFileSystem memo(*options.fs);
+            options.flags &= ~PATH_RESOLVE_FLAG_MEMO;
+            options.fs = &memo;
+            DWORD result = NO_ERROR;
+            const auto text = DecodeText(*input);
+            for (const auto part : text | std::views::split(L'\n'))
+            {
+                StrView line(part.begin(), part.end());
+                for (const auto item : line | std::views::split(L'\0'))
+                {
+                    StrView pattern(item.begin(), item.end());
+                    if (pattern.ends_with(L'\r'))
+                        pattern.remove_suffix(1);
+                    if (pattern.empty())
+                        continue;
+                    Path path(pattern);
+                    path.MakeAbsolute();
+                    const auto source = path;
+                    PathResolveStats stats;
+                    options.stats = trace ? &stats : nullptr;
+                    const auto error = path.Resolve(options);
+                    const auto resolved = error == ERROR_RESOURCE_ENUM_USER_STOP;
+                    if (!resolved) result = error;
+                    if (trace)
+                    {
+                        PrintResolveTrace(source, path, error, stats);
+                        continue;
+                    }
+                    PRINT(L"[{}] {}\n\"{}\"", error, SystemErrorToString(error), resolved ? (StrView)path : pattern);
+                }
+            }
+            if (trace)
+                PRINT(L"{{\"memo_hits\":{},\"memo_negative_hits\":{},\"memo_misses\":{}}}", memo.Hits(), memo.NegativeHits(), memo.Misses());
+            else
+                PRINT(L"memo: {} hits ({} not found), {} misses", memo.Hits(), memo.NegativeHits(), memo.Misses());
+            return result;
+        }
 
-    auto file = Path(READ_ADS_STR(L"file"));
-    auto wdir = Path(READ_ADS_STR(L"wdir"));
-    auto scmd = (WORD)READ_ADS_INT(L"scmd", SW_NORMAL);
-    auto flags = (uint32_t)READ_ADS_INT(L"flags", 0);
-    
-    if (args.size() && args[0] == L":RAW:")
-    {
-        args.erase(args.begin());
-        flags |= EXELNK_FLAG_RAW;
+        // Resolve the targets of the shims in a directory, and report them as JSON lines.
+        if (args[0] == L":SCAN:")
+        {
+            const String directory(args.size() >= 2 && args[1] != L"-" ? args[1] : modulePath.ToString(-1));
+            return ScanShims(directory, args.size() >= 3 ? args[2] : L"");
+        }
+
+        // Measure the functions in the launch path.
+        // With a shim, its configuration is also loaded as the shim does it, with and without the broker.
+        if (args[0] == L":BENCH:")
+        {
+            Vector<Benchmark> launch;
+            if (args.size() >= 3)
+            {
+                Path shim(args[2]);
+                shim.MakeAbsolute();
+                launch.push_back({ L"launch.local", [shim] {
+                    return LoadLaunchConfig(shim, true).config.ToString().size();
+                }, nullptr, true });
+                launch.push_back({ L"launch.broker", [shim] {
+                    return Broker::Request(shim).value_or(LaunchConfig()).config.ToString().size();
+                }, [shim] {
+                    return Broker::Request(shim).has_value();
+                }, true });
+            }
+            return RunBenchmarks(args.size() >= 2 ? args[1] : L"", launch);
+        }
     }
 
-    if (!file.Type())
+    auto launch = LoadLaunchConfig(modulePath, false);
+    if (launch.error != NO_ERROR)
     {
-        PRINT(L"INFO: file not set or invalid, run:");
-        PRINT(L"\t{} :SET: file <path>", moduleName);
-        return NO_ERROR;
+        PRINT(L"[{}] {}", launch.error, SystemErrorToString(launch.error));
+        return launch.error;
     }
 
-    // Resolve path wildcards with `FindFirstFileExW`.
-    // This is done recursively for each path segment.
-    if (Path::IsPattern(file)) file.Resolve();
-    if (Path::IsPattern(wdir)) wdir.Resolve();
-
-    // Build command line.
-    String cmdl;
-    AppendArgument(cmdl, file.Name());
-    AppendArgument(cmdl, READ_ADS_STR(L"args"), TRUE);
-    for (const auto& arg : args)
-        AppendArgument(cmdl, arg, BITALL(flags, EXELNK_FLAG_RAW));
-
-    DWORD creationFlags = 0;
-
-    if (isFinalProcess)
-        creationFlags |= CREATE_NEW_CONSOLE | CREATE_NEW_PROCESS_GROUP;
-
     PROCESS_INFORMATION pi { };
-    STARTUPINFOW si { .cb = sizeof(STARTUPINFOW), .dwFlags = STARTF_USESHOWWINDOW, .wShowWindow = scmd };
-    CHECK_ERROR(CreateProcessW(file, cmdl.data(), nullptr, nullptr, FALSE, creationFlags, nullptr, wdir, &si, &pi));
+    String responseFile;
+    const auto error = Launch(modulePath, launch.config, std::move(args), isFinalProcess, pi, responseFile);
+    launch = { };
+    if (!pi.hProcess)
+        return error;
+
+    CloseHandle(pi.hThread);
 
     DWORD exitCode = NO_ERROR;
 
-    if (!isFinalProcess)
+    // The response file is in use until the process exits.
+    if (!isFinalProcess || !responseFile.empty())
     {
+        // Only the process handle is needed while waiting.
+        TrimMemory();
         WaitForSingleObject(pi.hProcess, INFINITE);
         GetExitCodeProcess(pi.hProcess, &exitCode);
     }
 
-    CloseHandle(pi.hThread);
     CloseHandle(pi.hProcess);
 
+    if (!responseFile.empty())
+        DeleteFileW(responseFile.data());
+
     return exitCode;
 }
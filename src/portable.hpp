@@ -0,0 +1,71 @@
+#pragma once
+
+/***************************************************
+ * WINDOWS
+***************************************************/
+
+// The portable modules use the types and error codes of the Win32 API.
+// Outside Windows, only the subset they use is defined (see `CMakeLists.txt`).
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+
+#include <Windows.h>
+
+#undef GetCurrentDirectory
+#undef SetCurrentDirectory
+#undef GetEnvironmentVariable
+#undef SetEnvironmentVariable
+#else
+#include "lib/compat.hpp"
+#endif
+
+/***************************************************
+ * STD LIBRARY
+***************************************************/
+
+#include <format>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <deque>
+#include <ranges>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <span>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <iostream>
+#include <optional>
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// Defined by the system headers of other platforms; the Win32 limit is declared in `path.hpp`.
+#undef PATH_MAX
+
+using String = std::wstring;
+using StrView = std::wstring_view;
+
+template <typename T> using Vector = std::vector<T>;
+template <typename T> using Optional = std::optional<T>;
+template <typename T> using Function = std::function<T>;
+
+/***************************************************
+ * PROJECT
+***************************************************/
+
+#include "lib/util.hpp"
+#include "lib/fs.hpp"
+#include "lib/path.hpp"
+#include "lib/cache.hpp"
+#include "lib/config.hpp"
+#include "lib/env.hpp"
+#include "lib/dllhost.hpp"
+#include "lib/bench.hpp"
@@ -0,0 +1,8 @@
+#include "../portable.hpp"
+
+// Runs the benchmarks of the portable modules, like `exelnk.exe :BENCH: [filter]`.
+int main(int argc, char* argv[])
+{
+    const std::string_view filter = argc >= 2 ? argv[1] : "";
+    return (int)RunBenchmarks(String(filter.begin(), filter.end()));
+}
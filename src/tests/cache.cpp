@@ -0,0 +1,139 @@
+#include "check.hpp"
+
+// Adds a directory to the tree the first time a listing is read, like a change made during the search.
+class ChangingFileSystem final : public FileSystem
+{
+public:
+    ChangingFileSystem(MemoryFileSystem& fs, StrView path)
+        : m_fs(fs), m_path(path) { }
+
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override { return m_fs.GetAttributes(path, attributes); }
+    Optional<uint64_t> GetLastWriteTime(StrView path) const override { return m_fs.GetLastWriteTime(path); }
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override
+    {
+        if (!m_changed)
+            m_fs.AddDirectory(m_path), m_changed = true;
+        return m_fs.EnumerateFiles(path, fn);
+    }
+    DWORD EnumerateStreams(StrView path, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>& fn) const override { return m_fs.EnumerateStreams(path, fn); }
+private:
+    MemoryFileSystem& m_fs;
+    String m_path;
+    mutable bool m_changed = false;
+};
+
+// Resolves the pattern recording the directories searched, like the shim does on a cache miss.
+static auto Resolve(const FileSystem& fs, StrView pattern)
+{
+    ResolveCache cache(pattern);
+    const ResolveCacheRecorder recorder(fs, cache);
+    Path path(pattern);
+    const auto error = path.Resolve({ .fs = &recorder, .flags = PATH_RESOLVE_FLAG_RANK });
+    cache.SetTarget(path.ToString());
+    return std::pair(error, cache);
+}
+
+static void TestRoundTrip()
+{
+    MemoryFileSystem fs;
+    fs.AddFile(L"C:\\Python\\3.9\\python.exe");
+    fs.AddFile(L"C:\\Python\\3.12\\python.exe");
+
+    const auto [error, cache] = Resolve(fs, L"C:\\Python\\3.*\\python.exe");
+    CHECK(error == ERROR_RESOURCE_ENUM_USER_STOP);
+    CHECK(cache.Target().ends_with(L"\\3.12\\python.exe"));
+
+    const auto parsed = ResolveCache::Parse(cache.ToString());
+    CHECK(parsed.has_value());
+    CHECK(parsed && parsed->Pattern() == cache.Pattern());
+    CHECK(parsed && parsed->Target() == cache.Target());
+    CHECK(parsed && parsed->ToString() == cache.ToString());
+    CHECK(parsed && parsed->IsValid(fs));
+
+    CHECK(!ResolveCache::Parse(L""));
+    CHECK(!ResolveCache::Parse(L"C:\\Python\\3.*\\python.exe\n"));
+    CHECK(!ResolveCache::Parse(cache.ToString() + L"0000000000000001\n"));
+    CHECK(!ResolveCache::Parse(cache.ToString() + L"time C:\\Python\n"));
+}
+
+static void TestInvalidation()
+{
+    MemoryFileSystem fs;
+    fs.AddFile(L"C:\\Python\\3.9\\python.exe");
+    fs.AddFile(L"C:\\Python\\3.12\\python.exe");
+    fs.AddDirectory(L"C:\\Tools");
+    const auto pattern = L"C:\\Python\\3.*\\python.exe";
+
+    // A new version in a directory searched.
+    auto cache = Resolve(fs, pattern).second;
+    CHECK(cache.IsValid(fs));
+    fs.AddFile(L"C:\\Python\\3.13\\python.exe");
+    CHECK(!cache.IsValid(fs));
+    cache = Resolve(fs, pattern).second;
+    CHECK(cache.Target().ends_with(L"\\3.13\\python.exe"));
+    CHECK(cache.IsValid(fs));
+
+    // The target removed.
+    CHECK(fs.Remove(L"C:\\Python\\3.13\\python.exe"));
+    CHECK(!cache.IsValid(fs));
+    cache = Resolve(fs, pattern).second;
+    CHECK(cache.Target().ends_with(L"\\3.12\\python.exe"));
+    CHECK(cache.IsValid(fs));
+
+    // A directory not searched.
+    fs.AddFile(L"C:\\Tools\\app.exe");
+    CHECK(cache.IsValid(fs));
+}
+
+// A literal path probed in a missing directory depends on its creation.
+static void TestMissingDirectory()
+{
+    MemoryFileSystem fs;
+    fs.AddFile(L"C:\\Tools\\1\\app.exe");
+    fs.AddDirectory(L"C:\\Tools\\2");
+
+    const auto [error, cache] = Resolve(fs, L"C:\\Tools\\*\\bin\\app.exe");
+    CHECK(error != ERROR_RESOURCE_ENUM_USER_STOP);
+
+    auto stale = cache;
+    stale.SetTarget(L"C:\\Tools\\1\\app.exe");
+    CHECK(stale.IsValid(fs));
+    fs.AddDirectory(L"C:\\Tools\\2\\bin");
+    CHECK(!stale.IsValid(fs));
+}
+
+// The last write time is taken before each search, so a change during the search invalidates the result.
+static void TestChangeDuringSearch()
+{
+    MemoryFileSystem fs;
+    fs.AddFile(L"C:\\Python\\3.9\\python.exe");
+    const ChangingFileSystem changing(fs, L"C:\\Python\\3.12");
+
+    const auto [error, cache] = Resolve(changing, L"C:\\Python\\3.*\\python.exe");
+    CHECK(error == ERROR_RESOURCE_ENUM_USER_STOP);
+    CHECK(!cache.IsValid(fs));
+}
+
+// Merged resolutions depend on the directories searched by each one.
+static void TestMerge()
+{
+    MemoryFileSystem fs;
+    fs.AddFile(L"C:\\A\\1\\app.exe");
+    fs.AddFile(L"C:\\B\\1\\app.exe");
+
+    auto cache = Resolve(fs, L"C:\\A\\*\\app.exe").second;
+    cache.Merge(Resolve(fs, L"C:\\B\\*\\app.exe").second);
+    CHECK(cache.IsValid(fs));
+    fs.AddDirectory(L"C:\\B\\2");
+    CHECK(!cache.IsValid(fs));
+}
+
+int main()
+{
+    TestRoundTrip();
+    TestInvalidation();
+    TestMissingDirectory();
+    TestChangeDuringSearch();
+    TestMerge();
+    return Failures() != 0;
+}
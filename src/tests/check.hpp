@@ -0,0 +1,16 @@
+#pragma once
+
+#include "../portable.hpp"
+
+/**
+ * Checks shared by the tests of the portable modules.
+ * A failed check is reported with its location, and the test continues; `main` returns `Failures()`.
+ */
+inline int& Failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(expr) \
+    if (!(expr)) { std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #expr ") failed" << std::endl; ++Failures(); }
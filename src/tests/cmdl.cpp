@@ -0,0 +1,100 @@
+#include "check.hpp"
+
+#include <random>
+
+// Arguments quoted as the MSVC CRT expects them.
+static void TestQuoting()
+{
+    const std::pair<StrView, StrView> cases[] = {
+        { L"", L"\"\"" },
+        { L"abc", L"abc" },
+        { L"a\\b\\", L"a\\b\\" },
+        { L"a b", L"\"a b\"" },
+        { L"a\tb", L"\"a\tb\"" },
+        { L"a b\\", L"\"a b\\\\\"" },
+        { L"a\"b", L"\"a\\\"b\"" },
+        { L"a\\\"b", L"\"a\\\\\\\"b\"" },
+        { L"\\\\server\\share dir\\", L"\"\\\\server\\share dir\\\\\"" },
+    };
+    for (const auto& [arg, quoted] : cases)
+    {
+        String str;
+        CHECK(AppendArgument(str, arg) == quoted);
+        CHECK(ArgumentLength(arg) == quoted.size());
+    }
+
+    String str;
+    AppendArgument(str, L"", TRUE);
+    CHECK(str.empty());
+    AppendArgument(str, L"a \"b\"", TRUE);
+    AppendArgument(str, L"c", TRUE);
+    CHECK(str == L"a \"b\" c");
+}
+
+// The program name is not escaped: it ends at the next quote, and backslashes are literal.
+static void TestProgramName()
+{
+    CHECK(ParseCommandLine(L"\"C:\\Program Files\\app.exe\"x y") == Vector<String>({ L"C:\\Program Files\\app.exe", L"x", L"y" }));
+    CHECK(ParseCommandLine(L"C:\\app.exe\\\"") == Vector<String>({ L"C:\\app.exe\\\"" }));
+    CHECK(ParseCommandLine(L"app.exe  \t") == Vector<String>({ L"app.exe" }));
+    CHECK(ParseCommandLine(L"").empty());
+}
+
+// Command lines split with the documented rules of the MSVC CRT, independent of `AppendArgument`.
+// https://learn.microsoft.com/cpp/c-language/parsing-c-command-line-arguments
+static void TestParsing()
+{
+    const std::pair<StrView, Vector<String>> cases[] = {
+        { LR"(app "a b c" d e)", { L"app", L"a b c", L"d", L"e" } },
+        { LR"(app "ab\"c" "\\" d)", { L"app", LR"(ab"c)", LR"(\)", L"d" } },
+        { LR"(app a\\\b d"e f"g h)", { L"app", LR"(a\\\b)", L"de fg", L"h" } },
+        { LR"(app a\\\"b c d)", { L"app", LR"(a\"b)", L"c", L"d" } },
+        { LR"(app a\\\\"b c" d e)", { L"app", LR"(a\\b c)", L"d", L"e" } },
+        // Trailing backslashes before the closing quote.
+        { LR"(app "C:\dir\\" x)", { L"app", LR"(C:\dir\)", L"x" } },
+        { LR"(app "C:\dir\\\\")", { L"app", LR"(C:\dir\\)" } },
+        { LR"(app C:\dir\)", { L"app", LR"(C:\dir\)" } },
+        // Two quotes inside a quoted argument.
+        { LR"(app a"b"" c d)", { L"app", LR"(ab" c d)" } },
+        { LR"(app "say ""hi""" x)", { L"app", LR"(say "hi")", L"x" } },
+        // Empty arguments.
+        { LR"(app "" x)", { L"app", L"", L"x" } },
+        { LR"(app x "")", { L"app", L"x", L"" } },
+        { LR"(app """")", { L"app", LR"(")" } },
+    };
+    for (const auto& [cmdl, args] : cases)
+        CHECK(ParseCommandLine(cmdl) == args);
+}
+
+// Random arguments, with a fixed seed, written with `AppendArgument` and parsed back.
+static void TestRoundTrip()
+{
+    constexpr StrView alphabet = L"ab \t\"\\\\\\é";
+    std::mt19937 random(17);
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        Vector<String> args = { L"C:\\Program Files\\app.exe" };
+        String cmdl;
+        AppendArgument(cmdl, args[0]);
+        for (size_t count = random() % 6; count; --count)
+        {
+            String arg;
+            for (size_t length = random() % 12; length; --length)
+                arg.push_back(alphabet[random() % alphabet.size()]);
+            const auto size = cmdl.size();
+            AppendArgument(cmdl, arg);
+            CHECK(cmdl.size() - size == ArgumentLength(arg) + 1);
+            args.push_back(std::move(arg));
+        }
+        CHECK(ParseCommandLine(cmdl) == args);
+    }
+}
+
+int main()
+{
+    TestQuoting();
+    TestProgramName();
+    TestParsing();
+    TestRoundTrip();
+    return Failures() != 0;
+}
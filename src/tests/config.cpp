@@ -0,0 +1,108 @@
+#include "check.hpp"
+
+// Builds a payload byte by byte: the magic, the version, the length in UTF-16 code units, and the text.
+static std::string Payload(std::string_view magic, uint8_t version, uint32_t length, StrView text)
+{
+    std::string bytes(magic);
+    bytes.push_back((char)version);
+    for (size_t i = 0; i < 4; ++i)
+        bytes.push_back((char)(length >> i * 8));
+    for (const auto c : text)
+    {
+        bytes.push_back((char)(c & 0xFF));
+        bytes.push_back((char)(c >> 8 & 0xFF));
+    }
+    return bytes;
+}
+
+static void TestValid()
+{
+    const StrView text = L"file=C:\\Python\\3.*\\python.exe\nargs=-X utf8\n";
+    const auto config = Config::ParsePayload(Payload("ELNKCFG", 1, (uint32_t)text.size(), text));
+    CHECK(config.has_value());
+    CHECK(config && config->Get(L"file") == L"C:\\Python\\3.*\\python.exe");
+    CHECK(config && config->Get(L"ARGS") == L"-X utf8");
+    CHECK(config && !config->Get(L"wdir"));
+
+    // Characters outside ASCII, in little-endian order.
+    const StrView unicode = L"wdir=C:\\Users\\\u00C9l\u00E8ve\\\u6587\u6863\n";
+    const auto bytes = Payload("ELNKCFG", 1, (uint32_t)unicode.size(), unicode);
+    CHECK(bytes.substr(bytes.size() - 6) == std::string_view("\x87\x65\x63\x68\x0A\x00", 6));
+    const auto decoded = Config::ParsePayload(bytes);
+    CHECK(decoded && decoded->Get(L"wdir") == L"C:\\Users\\\u00C9l\u00E8ve\\\u6587\u6863");
+
+    // Round trip through `ToPayload()`.
+    Config original;
+    original.Set(L"file", L"C:\\Tools\\app.exe");
+    original.Set(L"resolve", L"threads=4 memo");
+    const auto parsed = Config::ParsePayload(original.ToPayload());
+    CHECK(parsed && parsed->ToString() == original.ToString());
+
+    // An empty text is a valid, empty configuration.
+    const auto empty = Config::ParsePayload(Payload("ELNKCFG", 1, 0, L""));
+    CHECK(empty && empty->ToString().empty());
+}
+
+static void TestInvalid()
+{
+    const StrView text = L"file=C:\\Tools\\app.exe\n";
+    const auto length = (uint32_t)text.size();
+
+    // Empty or truncated header.
+    CHECK(!Config::ParsePayload(""));
+    CHECK(!Config::ParsePayload("ELNKCFG"));
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 1, length, text).substr(0, 11)));
+
+    // Bad magic.
+    CHECK(!Config::ParsePayload(Payload("ELNKCFX", 1, length, text)));
+    CHECK(!Config::ParsePayload(Payload("elnkcfg", 1, length, text)));
+
+    // Unsupported version.
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 0, length, text)));
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 2, length, text)));
+
+    // A length larger than the buffer, including one that overflows a byte count.
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 1, length + 1, text)));
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 1, 0xFFFFFFFF, text)));
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 1, 0x80000000 + length, text)));
+
+    // A length smaller than the buffer.
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 1, length - 1, text)));
+
+    // An odd-length UTF-16 body.
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 1, length, text) + '\0'));
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 1, length, text).substr(0, 12 + length * 2 - 1)));
+
+    // A text that is not a configuration.
+    const StrView invalid = L"file C:\\Tools\\app.exe\n";
+    CHECK(!Config::ParsePayload(Payload("ELNKCFG", 1, (uint32_t)invalid.size(), invalid)));
+}
+
+// The values accepted by `IsValue` are read back as is from the text form; the others would not be.
+static void TestValues()
+{
+    for (const StrView value : { L"", L"C:\\Tools\\app.exe", L"-X utf8", L"a=b", L"\"a b\" c", L"a\rb" })
+    {
+        CHECK(Config::IsValue(value));
+        Config config;
+        config.Set(L"args", value);
+        const auto parsed = Config::Parse(config.ToString());
+        CHECK(parsed && parsed->Get(L"args") == value);
+    }
+    for (const StrView value : { L" a", L"a ", L"\ta", L"a\r", L"a\nb", L"a\nfile=b", L"\n" })
+    {
+        CHECK(!Config::IsValue(value));
+        Config config;
+        config.Set(L"args", value);
+        const auto parsed = Config::Parse(config.ToString());
+        CHECK(!parsed || parsed->Get(L"args") != value);
+    }
+}
+
+int main()
+{
+    TestValid();
+    TestInvalid();
+    TestValues();
+    return Failures() != 0;
+}
@@ -0,0 +1,74 @@
+#include "check.hpp"
+
+#include <filesystem>
+
+// Requests encoded like `CallRemote` sends them, and decoded like the host reads them.
+static void TestRequest()
+{
+    String args[] = { L"a b", L"", L"\"x\"", L"\u00E9" };
+    const PWSTR argv[] = { args[0].data(), args[1].data(), args[2].data(), args[3].data() };
+    const auto request = DllHost::EncodeRequest(L"C:\\Tools\\helper.dll", L"Run", argv);
+    CHECK(request == StrView(L"C:\\Tools\\helper.dll\0Run\0a b\0\0\"x\"\0\u00E9\0", 35));
+    const auto strings = DllHost::DecodeRequest(request);
+    CHECK(strings == Vector<String>({ L"C:\\Tools\\helper.dll", L"Run", L"a b", L"", L"\"x\"", L"\u00E9" }));
+
+    const auto empty = DllHost::DecodeRequest(DllHost::EncodeRequest(L"helper", L"#1", { }));
+    CHECK(empty == Vector<String>({ L"helper", L"#1" }));
+
+    CHECK(!DllHost::DecodeRequest(L""));
+    CHECK(!DllHost::DecodeRequest(StrView(L"helper\0", 7)));
+    CHECK(!DllHost::DecodeRequest(StrView(L"helper\0Run", 10))); // not terminated
+    CHECK(!DllHost::DecodeRequest(StrView(L"\0Run\0", 5)));
+    CHECK(!DllHost::DecodeRequest(StrView(L"helper\0\0", 8)));
+}
+
+static void TestResponse()
+{
+    const auto response = DllHost::EncodeResponse(ERROR_PROC_NOT_FOUND, 0xFFFFFFFE);
+    CHECK(DllHost::DecodeResponse(response) == std::pair((DWORD)ERROR_PROC_NOT_FOUND, (DWORD)0xFFFFFFFE));
+    CHECK(!DllHost::DecodeResponse(std::span(response).first(4)));
+    CHECK(!DllHost::DecodeResponse({ }));
+}
+
+// Requests served by a host, through `dlopen`, with the response framed as the pipe carries it.
+static void TestCall(StrView module)
+{
+    DllHost host;
+    const auto call = [&](StrView function, std::initializer_list<StrView> list) {
+        Vector<String> args(list.begin(), list.end());
+        Vector<PWSTR> argv;
+        for (auto& arg : args)
+            argv.push_back(arg.data());
+        const auto [error, exitCode] = host.Call(DllHost::EncodeRequest(module, function, argv));
+        return DllHost::DecodeResponse(DllHost::EncodeResponse(error, exitCode));
+    };
+    const auto ok = [](DWORD exitCode) { return std::pair((DWORD)NO_ERROR, exitCode); };
+
+    CHECK(call(L"Sum", { L"1", L"20", L"300" }) == ok(321));
+    CHECK(call(L"Sum", { }) == ok(0));
+    CHECK(call(L"Lengths", { L"ab", L"", L"a b c" }) == ok(3205));
+    CHECK(call(L"Counter", { }) == ok(1));
+    CHECK(call(L"Counter", { }) == ok(2));
+
+    CHECK(call(L"Missing", { }) == std::pair((DWORD)ERROR_PROC_NOT_FOUND, (DWORD)0));
+    CHECK(call(L"#1", { }) == std::pair((DWORD)ERROR_PROC_NOT_FOUND, (DWORD)0));
+    CHECK(host.Call(DllHost::EncodeRequest(String(module) + L".missing", L"Sum", { })) == std::pair((DWORD)ERROR_MOD_NOT_FOUND, (DWORD)0));
+    CHECK(host.Call(L"") == std::pair((DWORD)ERROR_INVALID_DATA, (DWORD)0));
+
+    // The function found is kept.
+    RUNDLLFN fn1, fn2;
+    CHECK(host.Find(module, L"Sum", fn1) == NO_ERROR);
+    CHECK(host.Find(module, L"Sum", fn2) == NO_ERROR && fn1 == fn2);
+}
+
+// The path of the test module is passed by `ctest`.
+int main(int argc, char* argv[])
+{
+    TestRequest();
+    TestResponse();
+    if (argc >= 2)
+        TestCall(std::filesystem::path(argv[1]).wstring());
+    else
+        CHECK(!"the path of the test module is missing");
+    return Failures() != 0;
+}
@@ -0,0 +1,169 @@
+#include "check.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+// A temporary directory, removed with its contents when the test ends.
+class TempDirectory final
+{
+public:
+    TempDirectory()
+    {
+        auto path = (fs::temp_directory_path() / "exelnk.XXXXXX").string();
+        if (!mkdtemp(path.data()))
+            throw std::runtime_error("mkdtemp");
+        m_path = path;
+    }
+    ~TempDirectory()
+    {
+        std::error_code error;
+        fs::remove_all(m_path, error);
+    }
+
+    const fs::path& Root() const { return m_path; }
+
+    void AddFile(const fs::path& path) const
+    {
+        fs::create_directories((m_path / path).parent_path());
+        std::ofstream(m_path / path) << "x";
+    }
+private:
+    fs::path m_path;
+};
+
+// Lists the directory, and returns the names and attributes found, sorted.
+static DWORD List(const FileSystem& fs, StrView path, Vector<std::pair<String, DWORD>>& entries)
+{
+    entries.clear();
+    const auto error = fs.EnumerateFiles(path,
+        [&](const FileEntry& entry) -> DWORD {
+            entries.emplace_back(entry.name, entry.attributes);
+            return NO_ERROR;
+        }
+    );
+    std::ranges::sort(entries);
+    return error;
+}
+
+static void TestAttributes(const TempDirectory& temp, const PosixFileSystem& fs)
+{
+    temp.AddFile("tools/app.exe");
+    DWORD attributes;
+    CHECK(fs.GetAttributes(L"C:\\tools", attributes) == NO_ERROR && attributes == FILE_ATTRIBUTE_DIRECTORY);
+    CHECK(fs.GetAttributes(L"C:\\tools\\app.exe", attributes) == NO_ERROR && attributes == FILE_ATTRIBUTE_NORMAL);
+    CHECK(fs.GetAttributes(L"\\\\?\\C:\\tools\\app.exe", attributes) == NO_ERROR && attributes == FILE_ATTRIBUTE_NORMAL);
+    CHECK(fs.GetAttributes(L"C:\\tools\\missing.exe", attributes) == ERROR_FILE_NOT_FOUND && attributes == INVALID_FILE_ATTRIBUTES);
+    CHECK(fs.GetAttributes(L"C:\\missing\\app.exe", attributes) == ERROR_PATH_NOT_FOUND);
+    CHECK(fs.GetAttributes(L"C:\\tools\\app.exe\\x", attributes) == ERROR_PATH_NOT_FOUND);
+    CHECK(fs.Exists(L"C:\\tools\\app.exe"));
+    CHECK(!fs.Exists(L"C:\\Tools\\app.exe")); // case-sensitive
+
+    // The last write time of a directory changes with its entries.
+    const auto tools = (temp.Root() / "tools").string();
+    const timespec times[2] = { { 1, 0 }, { 1000, 500 } };
+    CHECK(utimensat(AT_FDCWD, tools.c_str(), times, 0) == 0);
+    CHECK(fs.GetLastWriteTime(L"C:\\tools") == 1000000000500ull);
+    temp.AddFile("tools/new.exe");
+    CHECK(fs.GetLastWriteTime(L"C:\\tools") != 1000000000500ull);
+    CHECK(!fs.GetLastWriteTime(L"C:\\missing"));
+
+    // Files have only the default data stream.
+    Vector<String> streams;
+    const auto collect = [&](WIN32_FIND_STREAM_DATA* data) -> DWORD { streams.emplace_back(data->cStreamName); return NO_ERROR; };
+    CHECK(fs.EnumerateStreams(L"C:\\tools\\app.exe", collect) == ERROR_HANDLE_EOF);
+    CHECK(streams == Vector<String>({ L"::$DATA" }));
+    CHECK(fs.EnumerateStreams(L"C:\\tools", collect) == ERROR_HANDLE_EOF);
+    CHECK(streams.size() == 1);
+    CHECK(fs.EnumerateStreams(L"C:\\tools\\missing.exe", collect) == ERROR_FILE_NOT_FOUND);
+}
+
+static void TestEnumerate(const TempDirectory& temp, const PosixFileSystem& fs)
+{
+    temp.AddFile("list/a.exe");
+    temp.AddFile("list/b.txt");
+    temp.AddFile("list/.hidden");
+    temp.AddFile("list/sub/c.exe");
+    temp.AddFile("list/\xC3\x89l\xC3\xA8ve/d.exe"); // "Élève" in UTF-8
+    fs::create_directory_symlink(temp.Root() / "list/sub", temp.Root() / "list/link");
+    fs::create_symlink(temp.Root() / "list/missing", temp.Root() / "list/broken");
+
+    Vector<std::pair<String, DWORD>> entries;
+    CHECK(List(fs, L"C:\\list\\*", entries) == ERROR_NO_MORE_FILES);
+    CHECK(entries == (Vector<std::pair<String, DWORD>>({
+        { L".hidden", FILE_ATTRIBUTE_NORMAL },
+        { L"a.exe", FILE_ATTRIBUTE_NORMAL },
+        { L"b.txt", FILE_ATTRIBUTE_NORMAL },
+        { L"link", FILE_ATTRIBUTE_DIRECTORY },
+        { L"sub", FILE_ATTRIBUTE_DIRECTORY },
+        { L"\u00C9l\u00E8ve", FILE_ATTRIBUTE_DIRECTORY },
+    })));
+    CHECK(List(fs, L"C:\\list\\*.exe", entries) == ERROR_NO_MORE_FILES);
+    CHECK(entries == (Vector<std::pair<String, DWORD>>({ { L"a.exe", FILE_ATTRIBUTE_NORMAL } })));
+    CHECK(List(fs, L"C:\\list\\\u00C9*", entries) == ERROR_NO_MORE_FILES);
+    CHECK(entries.size() == 1);
+    CHECK(List(fs, L"C:\\list\\*.dll", entries) == ERROR_FILE_NOT_FOUND);
+    CHECK(List(fs, L"C:\\missing\\*", entries) == ERROR_PATH_NOT_FOUND);
+    CHECK(List(fs, L"C:\\list\\a.exe\\*", entries) == ERROR_PATH_NOT_FOUND);
+
+    // The error of the callback stops the listing.
+    size_t count = 0;
+    CHECK(fs.EnumerateFiles(L"C:\\list\\*", [&](const FileEntry&) -> DWORD { ++count; return ERROR_CANCELLED; }) == ERROR_CANCELLED);
+    CHECK(count == 1);
+}
+
+// Listings larger than a batch, and listings started from the callback of another one.
+static void TestBatches(const TempDirectory& temp, const PosixFileSystem& fs)
+{
+    constexpr size_t count = 2000;
+    for (size_t i = 0; i < count; ++i)
+        temp.AddFile(std::format("many/file-with-a-long-name-{:04}.txt", i));
+
+    Vector<std::pair<String, DWORD>> entries;
+    CHECK(List(fs, L"C:\\many\\*", entries) == ERROR_NO_MORE_FILES);
+    CHECK(entries.size() == count);
+    CHECK(!entries.empty() && entries.back().first == L"file-with-a-long-name-1999.txt");
+
+    size_t outer = 0, inner = 0;
+    CHECK(fs.EnumerateFiles(L"C:\\many\\*",
+        [&](const FileEntry& entry) -> DWORD {
+            const String name(entry.name);
+            ++outer;
+            if (outer % 500 == 1)
+                inner += List(fs, L"C:\\many\\*", entries) == ERROR_NO_MORE_FILES ? entries.size() : 0;
+            CHECK(entry.name == name);
+            return NO_ERROR;
+        }
+    ) == ERROR_NO_MORE_FILES);
+    CHECK(outer == count);
+    CHECK(inner == 4 * count);
+}
+
+static void TestResolve(const TempDirectory& temp, const PosixFileSystem& fs)
+{
+    temp.AddFile("Python/3.9/python");
+    temp.AddFile("Python/3.12/python");
+    fs::create_directories(temp.Root() / "Python/3.13");
+
+    Path path(L"C:\\Python\\3.*\\python");
+    CHECK(path.Resolve({ .fs = &fs, .flags = PATH_RESOLVE_FLAG_RANK }) == ERROR_RESOURCE_ENUM_USER_STOP);
+    CHECK(path.ToString() == L"\\\\?\\C:\\Python\\3.12\\python");
+
+    Path missing(L"C:\\Python\\3.*\\python3");
+    CHECK(missing.Resolve({ .fs = &fs }) != ERROR_RESOURCE_ENUM_USER_STOP);
+}
+
+int main()
+{
+    const TempDirectory temp;
+    const PosixFileSystem fs(temp.Root().string());
+    TestAttributes(temp, fs);
+    TestEnumerate(temp, fs);
+    TestBatches(temp, fs);
+    TestResolve(temp, fs);
+    return Failures() != 0;
+}
@@ -0,0 +1,37 @@
+// Functions in the form of `RUNDLLFN`, loaded by the tests of the DLL host.
+#ifdef _WIN32
+#include <Windows.h>
+#define EXPORT extern "C" __declspec(dllexport)
+#else
+#include "../lib/compat.hpp"
+#define EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+#include <cwchar>
+
+// Returns the sum of the arguments, or `0xFFFFFFFF` if the list does not end with a null pointer.
+EXPORT DWORD __stdcall Sum(INT argc, PWSTR argv[])
+{
+    if (argv[argc])
+        return 0xFFFFFFFF;
+    DWORD sum = 0;
+    for (INT i = 0; i < argc; ++i)
+        sum += (DWORD)std::wcstoul(argv[i], nullptr, 10);
+    return sum;
+}
+
+// Returns the number of arguments, and the length of each one as a digit: `{ L"ab", L"" }` is 220.
+EXPORT DWORD __stdcall Lengths(INT argc, PWSTR argv[])
+{
+    DWORD result = argc;
+    for (INT i = 0; i < argc; ++i)
+        result = result * 10 + (DWORD)std::wcslen(argv[i]);
+    return result;
+}
+
+// Counts its calls, to check that the module stays loaded.
+EXPORT DWORD __stdcall Counter(INT, PWSTR[])
+{
+    static DWORD count = 0;
+    return ++count;
+}
@@ -0,0 +1,265 @@
+#include "check.hpp"
+
+#include <cstdlib>
+#include <new>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Counts the allocations made by the search.
+static std::atomic<size_t> allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    if (const auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+/**
+ * A chain of `depth` directories named `d` under `\\?\C:`, each with `files` files; the last one contains `app.exe`.
+ * Queries are answered from the number of segments of the path, without a tree, so they are fast
+ * at any depth and make no allocations: only those of the search are counted.
+ */
+class ChainFileSystem final : public FileSystem
+{
+public:
+    ChainFileSystem(size_t depth, size_t files)
+        : m_depth(depth)
+    {
+        for (size_t i = 0; i < files; ++i)
+            m_files.push_back(std::format(L"file{}.txt", i));
+    }
+
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override
+    {
+        const auto level = Level(path);
+        const auto name = path.substr(path.find_last_of(L'\\') + 1);
+        attributes = name == L"d" && level <= m_depth ? FILE_ATTRIBUTE_DIRECTORY
+            : name == L"app.exe" && level == m_depth + 1 ? FILE_ATTRIBUTE_NORMAL
+            : INVALID_FILE_ATTRIBUTES;
+        return attributes == INVALID_FILE_ATTRIBUTES ? ERROR_FILE_NOT_FOUND : NO_ERROR;
+    }
+    Optional<uint64_t> GetLastWriteTime(StrView) const override
+    {
+        return 1;
+    }
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override
+    {
+        const auto level = Level(path) - 1; // of the directory listed
+        if (level > m_depth)
+            return ERROR_PATH_NOT_FOUND;
+        for (const auto& file : m_files)
+            if (const auto error = fn({ file, FILE_ATTRIBUTE_NORMAL }); error != NO_ERROR)
+                return error;
+        const auto error = level < m_depth ? fn({ L"d", FILE_ATTRIBUTE_DIRECTORY }) : fn({ L"app.exe", FILE_ATTRIBUTE_NORMAL });
+        return error != NO_ERROR ? error : ERROR_NO_MORE_FILES;
+    }
+    DWORD EnumerateStreams(StrView, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>&) const override
+    {
+        return ERROR_HANDLE_EOF;
+    }
+private:
+    // Returns the number of segments after the volume.
+    static size_t Level(StrView path)
+    {
+        path.remove_prefix(StrView(L"\\\\?\\C:").size());
+        return (size_t)std::ranges::count(path, L'\\');
+    }
+
+    size_t m_depth;
+    Vector<String> m_files;
+};
+
+/**
+ * `width` directories named `d<n>` under `\\?\C:`, each with a directory `s<n>`; only the last one contains `app.exe`.
+ * The queries are counted, to tell how far a search went.
+ */
+class WideFileSystem final : public FileSystem
+{
+public:
+    explicit WideFileSystem(size_t width)
+        : m_width(width)
+    {
+    }
+
+    DWORD GetAttributes(StrView path, DWORD& attributes) const override
+    {
+        ++queries;
+        const auto segments = Split(path);
+        const auto target = segments.size() == 3 && segments[2] == L"app.exe" && segments[0] == Last();
+        attributes = segments.size() <= 2 && Exists(segments) ? FILE_ATTRIBUTE_DIRECTORY
+            : target && Exists(segments) ? FILE_ATTRIBUTE_NORMAL
+            : INVALID_FILE_ATTRIBUTES;
+        return attributes == INVALID_FILE_ATTRIBUTES ? ERROR_FILE_NOT_FOUND : NO_ERROR;
+    }
+    Optional<uint64_t> GetLastWriteTime(StrView) const override
+    {
+        return 1;
+    }
+    DWORD EnumerateFiles(StrView path, const Function<DWORD(const FileEntry&)>& fn) const override
+    {
+        ++queries;
+        const auto segments = Split(path);
+        DWORD error = NO_ERROR;
+        if (segments.empty())
+            for (size_t n = 0; n < m_width && error == NO_ERROR; ++n)
+                error = fn({ std::format(L"d{}", n), FILE_ATTRIBUTE_DIRECTORY });
+        else if (segments.size() == 1 && Exists(segments))
+            error = fn({ L"s" + segments[0].substr(1), FILE_ATTRIBUTE_DIRECTORY });
+        else if (segments.size() == 2 && Exists(segments))
+            error = fn({ segments[0] == Last() ? L"app.exe" : L"other.txt", FILE_ATTRIBUTE_NORMAL });
+        else
+            return ERROR_PATH_NOT_FOUND;
+        return error != NO_ERROR ? error : ERROR_NO_MORE_FILES;
+    }
+    DWORD EnumerateStreams(StrView, const Function<DWORD(WIN32_FIND_STREAM_DATA*)>&) const override
+    {
+        return ERROR_HANDLE_EOF;
+    }
+
+    mutable std::atomic<size_t> queries = 0;
+private:
+    // Returns the segments after the volume; the listing pattern, if any, is not one of them.
+    static Vector<String> Split(StrView path)
+    {
+        path.remove_prefix(StrView(L"\\\\?\\C:").size());
+        if (path.ends_with(L"\\*"))
+            path.remove_suffix(2);
+        Vector<String> segments;
+        for (const auto part : path | std::views::split(L'\\'))
+            if (!std::ranges::empty(part))
+                segments.emplace_back(part.begin(), part.end());
+        return segments;
+    }
+    String Last() const
+    {
+        return std::format(L"d{}", m_width - 1);
+    }
+    bool Exists(const Vector<String>& segments) const
+    {
+        if (segments.empty())
+            return true;
+        const auto n = segments[0].size() > 1 && segments[0][0] == L'd' ? StrToInt(StrView(segments[0]).substr(1)) : std::nullopt;
+        return n && *n >= 0 && (size_t)*n < m_width && (segments.size() < 2 || segments[1] == L"s" + segments[0].substr(1));
+    }
+
+    size_t m_width;
+};
+
+// Runs the function on a thread with a small stack, far below the 1 MiB default of Windows.
+static void RunOnSmallStack(const Function<void()>& fn)
+{
+    constexpr size_t stackSize = 256 * 1024;
+#ifdef _WIN32
+    const auto hThread = CreateThread(nullptr, stackSize,
+        [](LPVOID param) -> DWORD { (*(const Function<void()>*)param)(); return 0; },
+        (LPVOID)&fn, STACK_SIZE_PARAM_IS_A_RESERVATION, nullptr);
+    WaitForSingleObject(hThread, INFINITE);
+    CloseHandle(hThread);
+#else
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, stackSize);
+    pthread_t thread;
+    pthread_create(&thread, &attributes,
+        [](void* param) -> void* { (*(const Function<void()>*)param)(); return nullptr; }, (void*)&fn);
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attributes);
+#endif
+}
+
+// Resolves the chain with a wildcard per level, on a small stack, and returns the number of allocations made.
+static size_t ResolveChain(size_t depth, size_t files)
+{
+    String pattern = L"\\\\?\\C:";
+    for (size_t i = 0; i < depth; ++i)
+        pattern += L"\\*";
+    pattern += L"\\app.exe";
+    const ChainFileSystem fs(depth, files);
+
+    size_t count = 0;
+    RunOnSmallStack([&] {
+        Path path(pattern);
+        const auto before = allocations.load();
+        const auto error = path.Resolve({ .fs = &fs });
+        count = allocations.load() - before;
+        CHECK(error == ERROR_RESOURCE_ENUM_USER_STOP);
+        CHECK(path.SegmentCount() == depth + 1);
+        CHECK(path.Name() == L"app.exe");
+        CHECK(path.Segment(depth - 1) == L"d");
+    });
+    return count;
+}
+
+// The search keeps its frames on the heap: the depth does not depend on the native stack,
+// and the allocations grow with the directories listed, not with the entries examined.
+static void TestDeepChain()
+{
+    for (size_t depth : { 500, 1000, 3000 })
+    {
+        const auto few = ResolveChain(depth, 1);
+        const auto many = ResolveChain(depth, 16);
+        CHECK(many == few);
+        CHECK(few < 2 * depth); // one listing per level
+    }
+}
+
+// The threads searching the subtrees find the same result as a single one, and stop at the backtrack limit.
+static void TestFanout()
+{
+    const WideFileSystem fs(64);
+    for (uint32_t threads : { 1, 4 })
+    {
+        // Each thread reuses its path, whose second segment is restored after each directory.
+        Path path(L"\\\\?\\C:\\*\\*\\app.exe");
+        CHECK(path.Resolve({ .fs = &fs, .threads = threads }) == ERROR_RESOURCE_ENUM_USER_STOP);
+        CHECK(path.ToString() == L"\\\\?\\C:\\d63\\s63\\app.exe");
+
+        fs.queries = 0;
+        Path limited(L"\\\\?\\C:\\*\\*\\app.exe");
+        CHECK(limited.Resolve({ .fs = &fs, .threads = threads, .maxBacktracks = 8 }) == ERROR_NOT_ENOUGH_QUOTA);
+        CHECK(fs.queries < 32);
+    }
+}
+
+// The alternatives that lose are cancelled, and have finished once the result is returned.
+static void TestHedged()
+{
+    std::atomic<bool> finished = false;
+    Vector<DWORD> errors;
+    const auto index = ResolveHedged(2, 1,
+        [&](size_t k, const std::atomic<bool>& cancel) -> DWORD {
+            if (k != 0)
+                return ERROR_RESOURCE_ENUM_USER_STOP;
+            while (!cancel)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            finished = true;
+            return ERROR_CANCELLED;
+        },
+        errors
+    );
+    CHECK(index == 1);
+    CHECK(finished);
+    CHECK(errors.size() == 2 && errors[0] == ERROR_CANCELLED && errors[1] == ERROR_RESOURCE_ENUM_USER_STOP);
+}
+
+int main()
+{
+    TestDeepChain();
+    TestFanout();
+    TestHedged();
+    return Failures() != 0;
+}